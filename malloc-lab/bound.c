@@ -0,0 +1,139 @@
+/*
+ * bound.c - Offline bounds on the heap a trace needs
+ *
+ * Every block of a trace is an interval of time (from the op that
+ * allocates it to the op that frees or reallocs it) with a size. A
+ * non-moving allocator must give blocks that are live at the same time
+ * disjoint, ALIGNMENT-aligned address ranges. The least heap that can
+ * do that for the whole trace (offline dynamic storage allocation) is
+ * NP-hard to find, so trace_bound brackets it:
+ *
+ *   lower  - the most payload ever live at once, each block rounded up
+ *            to ALIGNMENT, since no two blocks can share an aligned unit.
+ *            No allocator, even one that knows the future, does better.
+ *   packed - the heap of a real packing found offline: blocks are placed
+ *            largest first, each at the lowest aligned offset that does
+ *            not collide with a placed block whose interval overlaps its
+ *            own (greedy by size on the interval graph). An allocator
+ *            that knew the future could do at least this well.
+ *
+ * A realloc ends the old block and starts the new one at the same op, as
+ * if the allocator had resized it in place when it could.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bound.h"
+#include "config.h"
+
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) / ALIGNMENT * ALIGNMENT)
+
+/* A block's lifetime and footprint */
+typedef struct
+{
+	int start;	 /* op that allocates it */
+	int end;	 /* op that frees it (num_ops if never) */
+	size_t size; /* aligned size */
+	size_t off;	 /* offset in the packing */
+} ival_t;
+
+static int cmp_size(const void *a, const void *b);
+static void unix_error(char *msg);
+
+/*
+ * trace_bound - Compute the bounds for a trace
+ */
+void trace_bound(trace_t *trace, bound_t *bound)
+{
+	ival_t *iv, **placed;
+	int *open;
+	int i, j, n = 0, nplaced = 0;
+	size_t live = 0, off;
+
+	if ((iv = malloc((trace->num_ops + 1) * sizeof(ival_t))) == NULL ||
+		(open = malloc(trace->num_ids * sizeof(int))) == NULL)
+		unix_error("malloc failed in trace_bound");
+	for (i = 0; i < trace->num_ids; i++)
+		open[i] = -1;
+
+	/* Cut the trace into intervals, tracking the aligned live bytes */
+	bound->lower = 0;
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		traceop_t *op = &trace->ops[i];
+
+		if (open[op->index] >= 0)
+		{
+			iv[open[op->index]].end = i;
+			live -= iv[open[op->index]].size;
+			open[op->index] = -1;
+		}
+		if (op->type != FREE && op->size > 0)
+		{
+			iv[n].start = i;
+			iv[n].end = trace->num_ops;
+			iv[n].size = ALIGN(op->size);
+			live += iv[n].size;
+			open[op->index] = n++;
+		}
+		if (live > bound->lower)
+			bound->lower = live;
+	}
+
+	/*
+	 * Greedy by size: lowest offset clear of every overlapping block.
+	 * placed is kept sorted by offset, so the blocks in the way are met
+	 * in address order.
+	 */
+	qsort(iv, n, sizeof(ival_t), cmp_size);
+	if ((placed = malloc((n + 1) * sizeof(ival_t *))) == NULL)
+		unix_error("malloc failed in trace_bound");
+	bound->packed = 0;
+	for (i = 0; i < n; i++)
+	{
+		off = 0;
+		for (j = 0; j < nplaced && placed[j]->off < off + iv[i].size; j++)
+			if (placed[j]->start < iv[i].end && iv[i].start < placed[j]->end &&
+				placed[j]->off + placed[j]->size > off)
+				off = placed[j]->off + placed[j]->size;
+		iv[i].off = off;
+
+		/* Keep placed sorted: the scan may have passed blocks above off */
+		while (j > 0 && placed[j - 1]->off > off)
+			j--;
+		while (j < nplaced && placed[j]->off <= off)
+			j++;
+		memmove(&placed[j + 1], &placed[j], (nplaced - j) * sizeof(ival_t *));
+		placed[j] = &iv[i];
+		nplaced++;
+		if (off + iv[i].size > bound->packed)
+			bound->packed = off + iv[i].size;
+	}
+
+	free(placed);
+	free(open);
+	free(iv);
+}
+
+/*
+ * cmp_size - qsort order for packing: largest first, then by start
+ */
+static int cmp_size(const void *a, const void *b)
+{
+	const ival_t *x = a, *y = b;
+
+	if (x->size != y->size)
+		return (x->size < y->size) ? 1 : -1;
+	return x->start - y->start;
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
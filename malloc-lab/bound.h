@@ -0,0 +1,22 @@
+/*
+ * bound.h - Offline bounds on the heap a trace needs
+ */
+#ifndef __BOUND_H_
+#define __BOUND_H_
+
+#include <stddef.h>
+#include "trace.h"
+
+/*
+ * The least heap any non-moving allocator could serve the trace with
+ * lies between lower and packed.
+ */
+typedef struct
+{
+	size_t lower;  /* peak of the live payload, each rounded up to ALIGNMENT */
+	size_t packed; /* heap of an offline greedy packing of the trace */
+} bound_t;
+
+void trace_bound(trace_t *trace, bound_t *bound);
+
+#endif /* __BOUND_H_ */
@@ -41,7 +41,8 @@
  * contribution of throughput to the performance index. Once the
  * students surpass the AVG_LIBC_THRUPUT, they get no further benefit
  * to their score.  This deters students from building extremely fast,
- * but extremely stupid malloc packages.
+ * but extremely stupid malloc packages. mdriver -L replaces it with
+ * libc's throughput on the same traces, measured in the same run.
  */
 #define AVG_LIBC_THRUPUT      600E3  /* 600 Kops/sec */
 
@@ -69,4 +70,13 @@
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
 #define USE_GETTOD 1   /* gettimeofday (any Unix box) */
 
+/*
+ * Robust timing (mdriver -R, -W, -I), which replaces the method above:
+ * warmup runs, then timed runs until the 95% confidence interval of the
+ * median run time is within ROBUST_TARGET of the median
+ */
+#define ROBUST_WARMUP   2     /* untimed runs first */
+#define ROBUST_TARGET   0.01  /* +-1% */
+#define ROBUST_MAX_RUNS 200   /* stop trying for the target here */
+
 #endif /* __CONFIG_H */
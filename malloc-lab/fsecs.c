@@ -10,6 +10,10 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+static int robust = 0;                  /* set by set_fsecs_robust */
+static ftimer_params_t robust_params;
+static ftimer_result_t robust_result;   /* of the last fsecs */
+
 extern int verbose; /* -v option in mdriver.c */
 
 /*
@@ -44,6 +48,8 @@ void init_fsecs(void)
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
+    if (robust)
+	return ftimer_robust(f, argp, &robust_params, &robust_result);
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
@@ -54,4 +60,46 @@ double fsecs(fsecs_test_funct f, void *argp)
 #endif 
 }
 
+/*
+ * set_fsecs_robust - Time with ftimer_robust from now on, whatever
+ *    USE_xxx method config.h selects
+ */
+void set_fsecs_robust(int warmup, double target, int max_runs)
+{
+    robust = 1;
+    robust_params.warmup = warmup;
+    robust_params.min_runs = 10;
+    robust_params.max_runs = (max_runs < 1) ? 1 : max_runs;
+    robust_params.target = target;
+    if (verbose)
+	printf("Measuring performance with %d warmup runs, then up to %d "
+	       "runs for a 95%% interval within %.1f%% of the median.\n",
+	       warmup, robust_params.max_runs, 100 * target);
+}
+
+/*
+ * get_fsecs_result - The median and interval of the last robust fsecs
+ */
+void get_fsecs_result(ftimer_result_t *result)
+{
+    *result = robust_result;
+}
+
+/*
+ * set_fsecs_cold - Start every timed run with cold caches, or stop.
+ *    The flush streams a buffer sized to the last-level cache and is
+ *    not part of the time.
+ */
+void set_fsecs_cold(int cold)
+{
+    static int told = 0;
 
+    ftimer_set_cold(cold);
+#if USE_FCYC
+    /* fcyc always clears a little; back to its 512KB when warm */
+    set_fcyc_cache_size(cold ? 2 * ftimer_llc_size() : 1 << 19);
+#endif
+    if (verbose && cold && !told++)
+	printf("Flushing the %lu KB last-level cache before each timed run.\n",
+	       (unsigned long)(ftimer_llc_size() >> 10));
+}
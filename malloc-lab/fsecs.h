@@ -1,4 +1,16 @@
+#include "ftimer.h"
+
 typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* Switch fsecs to ftimer_robust: warmup runs, then runs until the 95%
+   interval of the median is within target (a fraction of it) */
+void set_fsecs_robust(int warmup, double target, int max_runs);
+
+/* The median and interval behind the last fsecs in robust mode */
+void get_fsecs_result(ftimer_result_t *result);
+
+/* Flush the caches before every timed run (1) or not (0) */
+void set_fsecs_cold(int cold);
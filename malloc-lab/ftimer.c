@@ -7,14 +7,36 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_now: a monotonic clock, for timing stretches of code inline
+ *    ftimer_robust: version that times runs one by one, after a warmup,
+ *        until the median is known to a given confidence
+ *
+ * After ftimer_set_cold(1), every timer flushes the caches before each
+ * run of f, outside the timed interval, so that f starts cold.
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
+/* Cache flushing for cold runs */
+#define LLC_DEFAULT (8 << 20) /* if the last-level cache can't be found */
+#define LINE_BYTES 64
+
+static int cold = 0;         /* flush before each run? */
+static char *flush_buf = NULL;
+static size_t flush_bytes = 0;
+
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static int cmp_double(const void *a, const void *b);
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -26,6 +48,15 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n)
     int i;
 
     init_etime();
+    if (cold) {
+	for (i = 0, tmeas = 0; i < n; i++) {
+	    ftimer_flush();
+	    start = get_etime();
+	    f(argp);
+	    tmeas += get_etime() - start;
+	}
+	return tmeas / n;
+    }
     start = get_etime();
     for (i = 0; i < n; i++) 
 	f(argp);
@@ -43,6 +74,16 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     struct timeval stv, etv;
     double diff;
 
+    if (cold) {
+	for (i = 0, diff = 0; i < n; i++) {
+	    ftimer_flush();
+	    gettimeofday(&stv, NULL);
+	    f(argp);
+	    gettimeofday(&etv, NULL);
+	    diff += 1E3*(etv.tv_sec - stv.tv_sec) + 1E-3*(etv.tv_usec-stv.tv_usec);
+	}
+	return (1E-3*diff/n);
+    }
     gettimeofday(&stv, NULL);
     for (i = 0; i < n; i++) 
 	f(argp);
@@ -52,6 +93,164 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/* 
+ * ftimer_now - Return the time in seconds from a monotonic clock
+ */
+double ftimer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1E-9*ts.tv_nsec;
+}
+
+/*
+ * ftimer_robust - Time f(argp) run by run with the monotonic clock.
+ * After params->warmup untimed runs (to fault in the heap and fill the
+ * caches), keep timing runs until the 95% confidence interval of the
+ * median is within params->target of it, or params->max_runs is
+ * reached. The interval comes from order statistics of the sorted run
+ * times, so it needs no assumption about their distribution, and a run
+ * slowed by an interrupt or a migration only moves it by one rank.
+ * Return the median; fill in *result if it is not NULL.
+ */
+double ftimer_robust(ftimer_test_funct f, void *argp,
+		     const ftimer_params_t *params, ftimer_result_t *result)
+{
+    double *t, *sorted, start, half;
+    int i, n, lo, hi;
+    ftimer_result_t r;
+
+    if ((t = malloc(params->max_runs * sizeof(double))) == NULL ||
+	(sorted = malloc(params->max_runs * sizeof(double))) == NULL) {
+	fprintf(stderr, "ftimer_robust: malloc error\n");
+	exit(1);
+    }
+
+    for (i = 0; i < params->warmup; i++)
+	f(argp);
+
+    for (n = 0; n < params->max_runs; ) {
+	if (cold)
+	    ftimer_flush();
+	start = ftimer_now();
+	f(argp);
+	t[n++] = ftimer_now() - start;
+	if (n < params->min_runs && n < params->max_runs)
+	    continue;
+
+	/* ranks n/2 -+ 1.96 sqrt(n)/2 bound the median at 95% */
+	memcpy(sorted, t, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+	half = 0.98 * sqrt(n);
+	lo = (int)floor(n / 2.0 - half);
+	hi = (int)ceil(n / 2.0 + half);
+	lo = (lo < 0) ? 0 : lo;
+	hi = (hi > n - 1) ? n - 1 : hi;
+	r.runs = n;
+	r.median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	r.lo = sorted[lo];
+	r.hi = sorted[hi];
+	if (r.hi - r.lo <= 2 * params->target * r.median)
+	    break;
+    }
+
+    free(sorted);
+    free(t);
+    if (result != NULL)
+	*result = r;
+    return r.median;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * ftimer_pin - Pin the calling process to one CPU, so that timed runs
+ * do not migrate between cores (and their caches) mid-run
+ */
+int ftimer_pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+/*
+ * ftimer_llc_size - Size in bytes of the largest cache of CPU 0 (the
+ * last-level cache), from sysfs, else sysconf, else LLC_DEFAULT
+ */
+size_t ftimer_llc_size(void)
+{
+    char path[128], unit = 0;
+    size_t size, best = 0;
+    long n;
+    FILE *fp;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+	sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+	if ((fp = fopen(path, "r")) == NULL)
+	    break;
+	if (fscanf(fp, "%ld%c", &n, &unit) >= 1 && n > 0) {
+	    size = n;
+	    if (unit == 'K')
+		size <<= 10;
+	    else if (unit == 'M')
+		size <<= 20;
+	    if (size > best)
+		best = size;
+	}
+	fclose(fp);
+    }
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if (best == 0 && (n = sysconf(_SC_LEVEL3_CACHE_SIZE)) > 0)
+	best = n;
+    if (best == 0 && (n = sysconf(_SC_LEVEL2_CACHE_SIZE)) > 0)
+	best = n;
+#endif
+    return best ? best : LLC_DEFAULT;
+}
+
+/*
+ * ftimer_set_cold - Turn cold runs on (1) or off (0). The flush buffer
+ * is twice the last-level cache, since caches with adaptive replacement
+ * keep part of what they hold when a stream only the size of the cache
+ * goes through them.
+ */
+void ftimer_set_cold(int on)
+{
+    cold = on;
+    if (cold && flush_buf == NULL) {
+	flush_bytes = 2 * ftimer_llc_size();
+	if ((flush_buf = malloc(flush_bytes)) == NULL) {
+	    fprintf(stderr, "ftimer_set_cold: malloc error\n");
+	    exit(1);
+	}
+	memset(flush_buf, 1, flush_bytes);
+    }
+}
+
+/*
+ * ftimer_flush - Evict what f left in the caches by writing a line of
+ * the flush buffer at a time, which also forces dirty lines out
+ */
+void ftimer_flush(void)
+{
+    volatile char *p = flush_buf;
+    size_t i;
+
+    if (p == NULL)
+	return;
+    for (i = 0; i < flush_bytes; i += LINE_BYTES)
+	p[i]++;
+}
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -1,3 +1,6 @@
+#ifndef __FTIMER_H_
+#define __FTIMER_H_
+
 /* 
  * Function timers 
  */
@@ -12,3 +15,37 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Return the time in seconds from a monotonic clock */
+double ftimer_now(void);
+
+/* Settings for ftimer_robust */
+typedef struct {
+    int warmup;      /* untimed runs before the first timed one */
+    int min_runs;    /* timed runs before the interval is checked */
+    int max_runs;    /* give up on the target after this many */
+    double target;   /* stop once the 95% interval is within this
+			fraction of the median (0.01 = +-1%) */
+} ftimer_params_t;
+
+/* What ftimer_robust measured */
+typedef struct {
+    int runs;        /* timed runs */
+    double median;   /* median run time, in seconds */
+    double lo, hi;   /* 95% confidence interval of the median */
+} ftimer_result_t;
+
+/* Time runs of f(argp) one by one until the median is known to within
+   the target, and return the median */
+double ftimer_robust(ftimer_test_funct f, void *argp,
+		     const ftimer_params_t *params, ftimer_result_t *result);
+
+/* Pin the calling process to one CPU. Return 0, or -1 on failure */
+int ftimer_pin(int cpu);
+
+/* Cold runs: flush the caches before each timed run of f */
+#include <stddef.h>
+size_t ftimer_llc_size(void);
+void ftimer_set_cold(int on);
+void ftimer_flush(void);
+
+#endif /* __FTIMER_H_ */
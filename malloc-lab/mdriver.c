@@ -15,12 +15,16 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <stdint.h>
 
 extern char *optarg; // Added declaration for optarg
 
 #include "mm.h"
 #include "memlib.h"
+#include "trace.h"
+#include "bound.h"
 #include "fsecs.h"
+#include "ftimer.h"
 #include "config.h"
 
 /**********************
@@ -32,6 +36,14 @@ extern char *optarg; // Added declaration for optarg
 #define HDRLINES 4		   /* number of header lines in a trace file */
 #define LINENUM(i) (i + 5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* The null allocator hands out addresses in a region this big, never touched */
+#define NULL_HEAP MAX_HEAP
+
+/* Sampled validation (-s) fills and checks this many bytes at each end
+   of a payload, and this many 8-byte words at random in between */
+#define SAMPLE_EDGE 64
+#define SAMPLE_WORDS 16
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p) ((((unsigned int)(p)) % ALIGNMENT) == 0)
 
@@ -47,30 +59,12 @@ typedef struct range_t
 	struct range_t *next; /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct
-{
-	enum
-	{
-		ALLOC,
-		FREE,
-		REALLOC
-	} type;	   /* type of request */
-	int index; /* index for free() to use later */
-	int size;  /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+/* A recently allocated block, in the replay that touches payloads */
 typedef struct
 {
-	int sugg_heapsize;	 /* suggested heap size (unused) */
-	int num_ids;		 /* number of alloc/realloc ids */
-	int num_ops;		 /* number of distinct requests */
-	int weight;			 /* weight for this trace (unused) */
-	traceop_t *ops;		 /* array of requests */
-	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
-	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+	char *p;   /* its payload, or NULL once freed or reallocated */
+	int index; /* its block id in the trace */
+} touch_t;
 
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
@@ -81,8 +75,44 @@ typedef struct
 {
 	trace_t *trace;
 	range_t *ranges;
+	int start;		  /* first op to time (mm only) */
+	int end;		  /* one past the last op to time (mm only) */
+	void *checkpoint; /* mm heap state before op start, or NULL if start is 0 */
+	char **blocks;	  /* trace->blocks before op start */
+	int window;		  /* blocks walked after each allocation (-T) */
+	touch_t *recent;  /* the last window blocks allocated, a ring */
+	int *slot;		  /* each block's place in recent, or -1 */
 } speed_t;
 
+/* Where the bytes of the mm heap go at one point in a trace (-O) */
+typedef struct
+{
+	size_t heap;		   /* heap size */
+	size_t payload;		   /* bytes requested by the live blocks */
+	size_t rounding;	   /* requests rounded up to a block size */
+	size_t sliver;		   /* block beyond that: remainders too small to split */
+	size_t meta;		   /* headers and footers of allocated blocks */
+	size_t free[MM_NBINS]; /* free blocks, by the bin they are on */
+	size_t other;		   /* outside any block (prologue, epilogue, ...) */
+} overhead_t;
+
+/* A live block of the trace, for matching with mm_walk_heap's blocks */
+typedef struct
+{
+	char *p;
+	size_t size;
+} live_t;
+
+/* State of a walk of the heap by heap_block */
+typedef struct
+{
+	live_t *live; /* the live blocks, by address */
+	int n;		  /* how many */
+	int next;	  /* the first one not yet matched */
+	size_t walked; /* bytes in the blocks seen */
+	overhead_t *ov;
+} walk_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct
 {
@@ -92,7 +122,17 @@ typedef struct
 	double secs; /* number of secs needed to run the trace */
 
 	/* defined only for the student malloc package */
-	double util; /* space utilization for this trace (always 0 for libc) */
+	double util;		/* space utilization for this trace (always 0 for libc) */
+	mm_fit_stats_t fit; /* find_fit search lengths during the util run */
+	size_t heap;		/* peak heap size during the util run */
+	bound_t bound;		/* offline bounds on the heap the trace needs (-B) */
+	double null_secs;	/* secs for the same replay with the null allocator (-n) */
+	ftimer_result_t timing; /* median and interval behind secs (-R) */
+	double cold_secs;	/* secs with the caches flushed before each run (-c) */
+	double touch_secs;	/* secs with the payloads written and walked (-T) */
+	int weight;			/* the trace's weight, from its header */
+	overhead_t ov_peak;	/* the heap when it first reaches its peak (-O) */
+	overhead_t ov_final; /* the heap at the end of the trace (-O) */
 
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -102,8 +142,16 @@ typedef struct
  *******************/
 int verbose = 0;	   /* global flag for verbose output */
 static int errors = 0; /* number of errs found when running student malloc */
+static int sampled = 0; /* If set, check payloads by sampling (-s) */
 char msg[MAXLINE];	   /* for whenever we need to compose an error message */
 
+/* Where eval_mm_touch_speed leaves what it read, so the reads stay */
+static volatile char touch_sink;
+
+/* The null allocator's region and its bump pointer */
+static char *null_heap;
+static size_t null_brk;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -121,10 +169,6 @@ static int add_range(range_t **ranges, char *lo, int size,
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
@@ -132,11 +176,42 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
+static void fill_payload(char *p, int index, int size);
+static int check_payload(char *p, int index, int fillsize, int size);
+static long check_fill(const char *p, int c, long n);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_restore(void *ptr);
+static void eval_mm_touch_speed(void *ptr);
+static double time_mm_speed(fsecs_test_funct f, speed_t *speed_params,
+							ftimer_result_t *timing);
+static void eval_mm_ops(trace_t *trace, int start, int end);
+static void eval_mm_profile(trace_t *trace, int tracenum, int window);
+static void eval_mm_overhead(trace_t *trace, int tracenum, stats_t *stats);
+static void heap_overhead(trace_t *trace, overhead_t *ov);
+static void heap_block(const mm_block_t *blk, void *arg);
+static int cmp_live(const void *a, const void *b);
+static void make_checkpoint(speed_t *params);
+static void free_checkpoint(speed_t *params);
+
+/* A null allocator, to time the replay loop on its own */
+static void *null_malloc(size_t size);
+static void *null_realloc(void *ptr, size_t size);
+static void null_free(void *ptr);
+static void eval_null_speed(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printfitstats(int n, stats_t *stats);
+static void printboundstats(int n, stats_t *stats);
+static void printoverheadstats(int n, stats_t *stats);
+static void printnetstats(int n, stats_t *stats);
+static void printtimingstats(int n, stats_t *stats);
+static void printcoldstats(int n, stats_t *stats);
+static void printtouchstats(int n, stats_t *stats);
+static void printlibcstats(int n, stats_t *mm_stats, stats_t *libc_stats);
+static void weighted_scores(int n, stats_t *mm_stats, stats_t *libc_stats,
+							double *util, double *ratio);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -159,16 +234,35 @@ int main(int argc, char **argv)
 
 	int team_check = 1; /* If set, check team structure (reset by -a) */
 	int run_libc = 0;	/* If set, run libc malloc (set by -l) */
+	int libc_cap = 0;	/* If set, cap throughput at libc's, measured (-L) */
 	int autograder = 0; /* If set, emit summary info for autograder (-g) */
+	int fit_policy = MM_FIT_BEST; /* mm placement policy (set by -F) */
+	int fit_max_probes = 0;		  /* per-bin probe bound (set by -K) */
+	int shared_heap = 0;		  /* If set, put the mm heap in shared memory (-S) */
+	int start_op = 0;			  /* time mm from a checkpoint at this op (-C) */
+	int end_op = -1;			  /* ... up to this op, or to the end if < 0 (-E) */
+	int profile_window = 0;		  /* if > 0, profile mm in windows of this many ops (-w) */
+	int offline_bound = 0;		  /* If set, compare mm with offline heap bounds (-B) */
+	int overhead = 0;			  /* If set, break the mm heap down by kind of waste (-O) */
+	int null_calibrate = 0;		  /* If set, time the replay loop with a null allocator (-n) */
+	int robust = 0;				  /* If set, time robustly (-R, or -W or -I) */
+	int warmup = ROBUST_WARMUP;	  /* untimed runs before timing (-W) */
+	double target = ROBUST_TARGET; /* 95% interval to reach, over the median (-I) */
+	int cpu = -1;				  /* if >= 0, pin the process to this CPU (-P) */
+	int cold = 0;				  /* If set, also time mm with cold caches (-c) */
+	int touch_window = 0;		  /* if > 0, also time mm under a payload-touching replay (-T) */
+	ftimer_result_t timing;
 
 	/* temporaries used to compute the performance index */
 	double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+	double thru_cap = AVG_LIBC_THRUPUT; /* throughput that earns full marks */
+	double wutil, wratio;
 	int numcorrect;
 
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF)
+	while ((c = getopt(argc, argv, "f:t:F:K:C:E:w:W:I:P:T:hvVgalLcnsORSB")) != EOF)
 	{
 		printf("getopt returned: %d\n", c); // 디버깅용 출력 추가
 
@@ -192,12 +286,76 @@ int main(int argc, char **argv)
 			if (tracedir[strlen(tracedir) - 1] != '/')
 				strcat(tracedir, "/"); /* path always ends with "/" */
 			break;
+		case 'F': /* Placement policy for mm.c */
+			if (!strcmp(optarg, "best"))
+				fit_policy = MM_FIT_BEST;
+			else if (!strcmp(optarg, "first"))
+				fit_policy = MM_FIT_FIRST;
+			else if (!strcmp(optarg, "next"))
+				fit_policy = MM_FIT_NEXT;
+			else
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'K': /* Give up on a bin after this many probes */
+			fit_max_probes = atoi(optarg);
+			break;
+		case 'C': /* Start the mm speed run from a checkpoint at this op */
+			start_op = atoi(optarg);
+			break;
+		case 'E': /* End the mm speed run at this op */
+			end_op = atoi(optarg);
+			break;
+		case 'w': /* Profile mm throughput in windows of this many ops */
+			profile_window = atoi(optarg);
+			break;
 		case 'a': /* Don't check team structure */
 			team_check = 0;
 			break;
 		case 'l': /* Run libc malloc */
 			run_libc = 1;
 			break;
+		case 'L': /* Cap throughput at libc's, measured here (implies -l) */
+			run_libc = 1;
+			libc_cap = 1;
+			break;
+		case 'c': /* Time mm a second time, with cold caches */
+			cold = 1;
+			break;
+		case 'n': /* Time the replay loop alone, with a null allocator */
+			null_calibrate = 1;
+			break;
+		case 's': /* Check payloads at their ends and at random words only */
+			sampled = 1;
+			break;
+		case 'R': /* Time with warmup runs and a confidence interval */
+			robust = 1;
+			break;
+		case 'W': /* Untimed warmup runs before timing (implies -R) */
+			robust = 1;
+			warmup = atoi(optarg);
+			break;
+		case 'I': /* Target 95% interval in percent of the median (implies -R) */
+			robust = 1;
+			target = atof(optarg) / 100;
+			break;
+		case 'P': /* Pin to this CPU while timing */
+			cpu = atoi(optarg);
+			break;
+		case 'T': /* Touch payloads, walking this many recent blocks */
+			touch_window = atoi(optarg);
+			break;
+		case 'S': /* Run mm.c on a shared-memory heap */
+			shared_heap = 1;
+			break;
+		case 'B': /* Compare mm's heap with offline bounds */
+			offline_bound = 1;
+			break;
+		case 'O': /* Break mm's heap down into payload and overheads */
+			overhead = 1;
+			break;
 		case 'v': /* Print per-trace performance breakdown */
 			verbose = 1;
 			break;
@@ -257,6 +415,10 @@ int main(int argc, char **argv)
 
 	/* Initialize the timing package */
 	init_fsecs();
+	if (robust)
+		set_fsecs_robust(warmup, target, ROBUST_MAX_RUNS);
+	if (cpu >= 0 && ftimer_pin(cpu) < 0)
+		unix_error("ERROR: could not pin to the CPU given with -P");
 
 	/*
 	 * Optionally run and evaluate the libc malloc package
@@ -295,6 +457,20 @@ int main(int argc, char **argv)
 			printf("\nResults for libc malloc:\n");
 			printresults(num_tracefiles, libc_stats);
 		}
+
+		/* libc's throughput over the same traces replaces the constant */
+		if (libc_cap)
+		{
+			secs = 0;
+			ops = 0;
+			for (i = 0; i < num_tracefiles; i++)
+			{
+				secs += libc_stats[i].secs;
+				ops += libc_stats[i].ops;
+			}
+			if (secs > 0)
+				thru_cap = ops / secs;
+		}
 	}
 
 	/*
@@ -309,13 +485,34 @@ int main(int argc, char **argv)
 		unix_error("mm_stats calloc in main failed");
 
 	/* Initialize the simulated memory system in memlib.c */
-	mem_init();
+	if (shared_heap)
+		mem_init_shared(NULL);
+	else
+		mem_init();
+	mm_set_fit_policy(fit_policy, fit_max_probes);
+	if (start_op < 0)
+		app_error("-C needs an op number of 0 or more");
+	if (start_op > 0 && mm_state_size() == 0)
+		app_error("-C needs an mm.c that supports checkpoints");
+	if (null_calibrate && (null_heap = malloc(NULL_HEAP)) == NULL)
+		unix_error("null_heap malloc in main failed");
 
 	/* Evaluate student's mm malloc package using the K-best scheme */
 	for (i = 0; i < num_tracefiles; i++)
 	{
 		trace = read_trace(tracedir, tracefiles[i]);
-		mm_stats[i].ops = trace->num_ops;
+		speed_params.trace = trace;
+		speed_params.end = (end_op < 0 || end_op > trace->num_ops) ? trace->num_ops : end_op;
+		if (start_op > 0 && start_op >= speed_params.end)
+		{
+			sprintf(msg, "-C %d leaves no ops to time in %s (it ends at op %d)",
+					start_op, tracefiles[i], speed_params.end);
+			app_error(msg);
+		}
+		speed_params.start = start_op;
+		speed_params.checkpoint = NULL;
+		mm_stats[i].ops = speed_params.end - speed_params.start;
+		mm_stats[i].weight = trace->weight;
 		if (verbose > 1)
 			printf("Checking mm_malloc for correctness, ");
 		mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
@@ -324,11 +521,43 @@ int main(int argc, char **argv)
 			if (verbose > 1)
 				printf("efficiency, ");
 			mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-			speed_params.trace = trace;
+			mm_get_fit_stats(&mm_stats[i].fit);
+			mm_stats[i].heap = mem_heappeak();
+			if (offline_bound)
+				trace_bound(trace, &mm_stats[i].bound);
+			if (overhead)
+				eval_mm_overhead(trace, i, &mm_stats[i]);
 			speed_params.ranges = ranges;
 			if (verbose > 1)
 				printf("and performance.\n");
-			mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+			if (speed_params.start > 0)
+				make_checkpoint(&speed_params);
+			mm_stats[i].secs = time_mm_speed(eval_mm_speed, &speed_params,
+											 &mm_stats[i].timing);
+			if (cold)
+			{
+				set_fsecs_cold(1);
+				mm_stats[i].cold_secs = time_mm_speed(eval_mm_speed, &speed_params,
+													  &timing);
+				set_fsecs_cold(0);
+			}
+			if (touch_window > 0)
+			{
+				speed_params.window = touch_window;
+				if ((speed_params.recent = malloc(touch_window * sizeof(touch_t))) == NULL ||
+					(speed_params.slot = malloc(trace->num_ids * sizeof(int))) == NULL)
+					unix_error("malloc failed in main");
+				mm_stats[i].touch_secs = time_mm_speed(eval_mm_touch_speed,
+													   &speed_params, &timing);
+				free(speed_params.recent);
+				free(speed_params.slot);
+			}
+			if (speed_params.start > 0)
+				free_checkpoint(&speed_params);
+			if (null_calibrate)
+				mm_stats[i].null_secs = fsecs(eval_null_speed, &speed_params);
+			if (profile_window > 0)
+				eval_mm_profile(trace, i, profile_window);
 		}
 		free_trace(trace);
 	}
@@ -338,6 +567,50 @@ int main(int argc, char **argv)
 	{
 		printf("\nResults for mm malloc:\n");
 		printresults(num_tracefiles, mm_stats);
+		printf("\nFit search for mm malloc:\n");
+		printfitstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (offline_bound)
+	{
+		printf("Offline bounds for mm malloc (heap sizes in KB):\n");
+		printboundstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (overhead)
+	{
+		printoverheadstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (robust)
+	{
+		printf("Timing of mm malloc (median run, 95%% interval):\n");
+		printtimingstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (cold)
+	{
+		printf("Warm and cold-cache throughput of mm malloc:\n");
+		printcoldstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (touch_window > 0)
+	{
+		printf("mm malloc under an application touching its payloads "
+			   "(%d-block window):\n", touch_window);
+		printtouchstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (null_calibrate)
+	{
+		printf("mm malloc net of the replay loop (null allocator):\n");
+		printnetstats(num_tracefiles, mm_stats);
+		printf("\n");
+	}
+	if (run_libc)
+	{
+		printf("mm malloc against libc malloc (weights from the trace headers):\n");
+		printlibcstats(num_tracefiles, mm_stats, libc_stats);
 		printf("\n");
 	}
 
@@ -365,15 +638,33 @@ int main(int argc, char **argv)
 	{
 		avg_mm_throughput = ops / secs;
 
+		/*
+		 * With libc run, also give the index with no cap on throughput:
+		 * weighted averages over the traces of the utilization and of
+		 * mm's throughput relative to libc's on the same trace. It goes
+		 * past 100 when mm is faster than libc.
+		 */
+		if (run_libc)
+		{
+			weighted_scores(num_tracefiles, mm_stats, libc_stats, &wutil, &wratio);
+			printf("Uncapped index = %.0f (util) + %.0f (thru) = %.0f\n",
+				   UTIL_WEIGHT * wutil * 100,
+				   (1.0 - UTIL_WEIGHT) * wratio * 100,
+				   (UTIL_WEIGHT * wutil + (1.0 - UTIL_WEIGHT) * wratio) * 100);
+		}
+		if (libc_cap)
+			printf("Throughput cap = %.0f Kops (libc malloc, measured)\n",
+				   thru_cap / 1e3);
+
 		p1 = UTIL_WEIGHT * avg_mm_util;
-		if (avg_mm_throughput > AVG_LIBC_THRUPUT)
+		if (avg_mm_throughput > thru_cap)
 		{
 			p2 = (double)(1.0 - UTIL_WEIGHT);
 		}
 		else
 		{
 			p2 = ((double)(1.0 - UTIL_WEIGHT)) *
-				 (avg_mm_throughput / AVG_LIBC_THRUPUT);
+				 (avg_mm_throughput / thru_cap);
 		}
 
 		perfindex = (p1 + p2) * 100.0;
@@ -501,110 +792,6 @@ static void clear_ranges(range_t **ranges)
 	*ranges = NULL;
 }
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
-/*
- * read_trace - read a trace file and store it in memory
- */
-static trace_t *read_trace(char *tracedir, char *filename)
-{
-	FILE *tracefile;
-	trace_t *trace;
-	char type[MAXLINE];
-	char path[MAXLINE];
-	unsigned index, size;
-	unsigned max_index = 0;
-	unsigned op_index;
-
-	if (verbose > 1)
-		printf("Reading tracefile: %s\n", filename);
-
-	/* Allocate the trace record */
-	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
-		unix_error("malloc 1 failed in read_trance");
-
-	/* Read the trace file header */
-	strcpy(path, tracedir);
-	strcat(path, filename);
-	if ((tracefile = fopen(path, "r")) == NULL)
-	{
-		sprintf(msg, "Could not open %s in read_trace", path);
-		unix_error(msg);
-	}
-	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-	fscanf(tracefile, "%d", &(trace->num_ids));
-	fscanf(tracefile, "%d", &(trace->num_ops));
-	fscanf(tracefile, "%d", &(trace->weight)); /* not used */
-
-	/* We'll store each request line in the trace in this array */
-	if ((trace->ops =
-			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-		unix_error("malloc 2 failed in read_trace");
-
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
-
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
-
-	/* read every request line in the trace file */
-	index = 0;
-	op_index = 0;
-	while (fscanf(tracefile, "%s", type) != EOF)
-	{
-		switch (type[0])
-		{
-		case 'a':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = ALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'r':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = REALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'f':
-			fscanf(tracefile, "%ud", &index);
-			trace->ops[op_index].type = FREE;
-			trace->ops[op_index].index = index;
-			break;
-		default:
-			printf("Bogus type character (%c) in tracefile %s\n",
-				   type[0], path);
-			exit(1);
-		}
-		op_index++;
-	}
-	fclose(tracefile);
-	assert(max_index == trace->num_ids - 1);
-	assert(trace->num_ops == op_index);
-
-	return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-	free(trace->ops); /* free the three arrays... */
-	free(trace->blocks);
-	free(trace->block_sizes);
-	free(trace); /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -615,10 +802,9 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
-	int i, j;
+	int i;
 	int index;
 	int size;
-	int oldsize;
 	char *newp;
 	char *oldp;
 	char *p;
@@ -665,7 +851,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			 * if we realloc the block and wish to make sure that the old
 			 * data was copied to the new block
 			 */
-			memset(p, index & 0xFF, size);
+			fill_payload(p, index, size);
 
 			/* Remember region */
 			trace->blocks[index] = p;
@@ -694,19 +880,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			 * block and then fill in the new block with the low order byte
 			 * of the new index
 			 */
-			oldsize = trace->block_sizes[index];
-			if (size < oldsize)
-				oldsize = size;
-			for (j = 0; j < oldsize; j++)
+			if (!check_payload(newp, index, trace->block_sizes[index], size))
 			{
-				if (newp[j] != (index & 0xFF))
-				{
-					malloc_error(tracenum, i, "mm_realloc did not preserve the "
-											  "data from old block");
-					return 0;
-				}
+				malloc_error(tracenum, i, "mm_realloc did not preserve the "
+										  "data from old block");
+				return 0;
 			}
-			memset(newp, index & 0xFF, size);
+			fill_payload(newp, index, size);
 
 			/* Remember region */
 			trace->blocks[index] = newp;
@@ -730,15 +910,94 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	return 1;
 }
 
+/*
+ * fill_payload - Fill block index's payload with the low byte of index:
+ *    all of it, or with -s only SAMPLE_EDGE bytes at each end and
+ *    SAMPLE_WORDS words at offsets drawn from index and size
+ */
+static void fill_payload(char *p, int index, int size)
+{
+	uint64_t x = (uint64_t)index * 0x9E3779B97F4A7C15ULL + size;
+	int k, span = size - 2 * SAMPLE_EDGE - 8;
+
+	if (!sampled || span <= 8 * SAMPLE_WORDS)
+	{
+		memset(p, index & 0xFF, size);
+		return;
+	}
+	memset(p, index & 0xFF, SAMPLE_EDGE);
+	memset(p + size - SAMPLE_EDGE, index & 0xFF, SAMPLE_EDGE);
+	for (k = 0; k < SAMPLE_WORDS; k++)
+	{
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		memset(p + SAMPLE_EDGE + (x >> 33) % (span + 1), index & 0xFF, 8);
+	}
+}
+
+/*
+ * check_payload - Check that the first size bytes of block index's
+ *    payload at p hold what fill_payload wrote when the block had
+ *    fillsize bytes. Return 1 if they do, 0 if not.
+ */
+static int check_payload(char *p, int index, int fillsize, int size)
+{
+	uint64_t x = (uint64_t)index * 0x9E3779B97F4A7C15ULL + fillsize;
+	int k, o, span = fillsize - 2 * SAMPLE_EDGE - 8;
+	int n = (size < fillsize) ? size : fillsize;
+
+	if (!sampled || span <= 8 * SAMPLE_WORDS)
+		return check_fill(p, index & 0xFF, n) < 0;
+
+	if (check_fill(p, index & 0xFF, (n < SAMPLE_EDGE) ? n : SAMPLE_EDGE) >= 0)
+		return 0;
+	o = fillsize - SAMPLE_EDGE;
+	if (o < n && check_fill(p + o, index & 0xFF, n - o) >= 0)
+		return 0;
+	for (k = 0; k < SAMPLE_WORDS; k++)
+	{
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		o = SAMPLE_EDGE + (x >> 33) % (span + 1);
+		if (o + 8 <= n && check_fill(p + o, index & 0xFF, 8) >= 0)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * check_fill - Return the offset of the first of the n bytes at p that
+ *    is not c, or -1 if there is none. The bytes are compared 64 at a
+ *    time as 8 words or'ed together, which the compiler vectorizes.
+ */
+static long check_fill(const char *p, int c, long n)
+{
+	uint64_t pat = 0x0101010101010101ULL * (unsigned char)c;
+	uint64_t w[8], diff;
+	long i = 0;
+	int k;
+
+	for (; i + 64 <= n; i += 64)
+	{
+		memcpy(w, p + i, 64);
+		diff = 0;
+		for (k = 0; k < 8; k++)
+			diff |= w[k] ^ pat;
+		if (diff != 0)
+			break;
+	}
+	for (; i < n; i++)
+		if ((unsigned char)p[i] != (unsigned char)c)
+			return i;
+	return -1;
+}
+
 /*
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
  *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   package on the trace. mem_sbrk() lets the package shrink the heap,
+ *   so the heap size used here is memlib's high water mark of brk.
  *
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
@@ -819,7 +1078,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		}
 	}
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_heappeak());
 }
 
 /*
@@ -828,17 +1087,368 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
-	char *p, *newp, *oldp, *block;
-	trace_t *trace = ((speed_t *)ptr)->trace;
+	speed_t *params = (speed_t *)ptr;
+
+	if (params->checkpoint != NULL)
+		eval_mm_restore(ptr);
+	else
+	{
+		/* Reset the heap and initialize the mm package */
+		mem_reset_brk();
+		if (mm_init() < 0)
+			app_error("mm_init failed in eval_mm_speed");
+	}
+	eval_mm_ops(params->trace, params->start, params->end);
+}
+
+/*
+ * eval_mm_touch_speed - eval_mm_speed with an application on top. Every
+ *    new payload, from mm_malloc or mm_realloc, is written in full, and
+ *    then the first byte of each of the last window blocks allocated (and
+ *    still live) is read, as a program walking what it has just built.
+ *    Blocks placed close together share cache lines and pages here,
+ *    where eval_mm_speed never looks at a payload.
+ */
+static void eval_mm_touch_speed(void *ptr)
+{
+	speed_t *params = (speed_t *)ptr;
+	trace_t *trace = params->trace;
+	touch_t *recent = params->recent;
+	int *slot = params->slot;
+	int i, j, index, size, next = 0;
+	char *p, sum = 0;
+
+	if (params->checkpoint != NULL)
+		eval_mm_restore(ptr);
+	else
+	{
+		mem_reset_brk();
+		if (mm_init() < 0)
+			app_error("mm_init failed in eval_mm_touch_speed");
+	}
+	for (j = 0; j < params->window; j++)
+		recent[j].p = NULL;
+	for (j = 0; j < trace->num_ids; j++)
+		slot[j] = -1;
+
+	for (i = params->start; i < params->end; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC: /* mm_malloc */
+			if ((p = mm_malloc(size)) == NULL)
+				app_error("mm_malloc error in eval_mm_touch_speed");
+			break;
+
+		case REALLOC: /* mm_realloc */
+			if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+				app_error("mm_realloc error in eval_mm_touch_speed");
+			break;
+
+		case FREE: /* mm_free */
+			mm_free(trace->blocks[index]);
+			if (slot[index] >= 0)
+				recent[slot[index]].p = NULL;
+			slot[index] = -1;
+			continue;
+
+		default:
+			app_error("Nonexistent request type in eval_mm_touch_speed");
+			return;
+		}
+		trace->blocks[index] = p;
+		memset(p, i, size);
+
+		/* The block goes to the head of the ring, evicting the oldest */
+		if (slot[index] >= 0)
+			recent[slot[index]].p = NULL;
+		if (recent[next].p != NULL)
+			slot[recent[next].index] = -1;
+		recent[next].p = p;
+		recent[next].index = index;
+		slot[index] = next;
+		next = (next + 1 == params->window) ? 0 : next + 1;
+
+		for (j = 0; j < params->window; j++)
+			if (recent[j].p != NULL)
+				sum += recent[j].p[0];
+	}
+	touch_sink = sum;
+}
+
+/*
+ * time_mm_speed - Time one of the mm speed routines on ops start..end
+ *    with fsecs, filling in the robust timing if there is one. From a
+ *    checkpoint, the cost of the restore is taken out; a range too short
+ *    to measure against the restore is an error. Note that the restore itself
+ *    brings the checkpointed heap back into the cache, so a cold run from
+ *    a checkpoint starts with only the caches beyond the heap copy cold.
+ */
+static double time_mm_speed(fsecs_test_funct f, speed_t *speed_params,
+							ftimer_result_t *timing)
+{
+	double secs, restore;
+
+	secs = fsecs(f, speed_params);
+	get_fsecs_result(timing);
+	if (speed_params->start == 0)
+		return secs;
+	restore = fsecs(eval_mm_restore, speed_params);
+	if (secs - restore <= 0)
+	{
+		sprintf(msg, "ops %d..%d run no longer than the checkpoint restore (%g secs); "
+					 "move -C back or -E on",
+				speed_params->start, speed_params->end, restore);
+		app_error(msg);
+	}
+	secs -= restore;
+	timing->median -= restore;
+	timing->lo -= restore;
+	timing->hi -= restore;
+	return secs;
+}
+
+/*
+ * eval_mm_restore - Roll the mm heap and the trace's block pointers back
+ *    to the checkpoint. Timed on its own so that eval_mm_speed's figure
+ *    can be corrected for it.
+ */
+static void eval_mm_restore(void *ptr)
+{
+	speed_t *params = (speed_t *)ptr;
+
+	mm_load_state(params->checkpoint);
+	memcpy(params->trace->blocks, params->blocks,
+		   params->trace->num_ids * sizeof(char *));
+}
+
+/*
+ * make_checkpoint - Replay ops 0..start-1 on a fresh heap and save the
+ *    result, so that eval_mm_speed can skip them
+ */
+static void make_checkpoint(speed_t *params)
+{
+	trace_t *trace = params->trace;
+	size_t len = trace->num_ids * sizeof(char *);
 
-	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
 	if (mm_init() < 0)
-		app_error("mm_init failed in eval_mm_speed");
+		app_error("mm_init failed in make_checkpoint");
+	eval_mm_ops(trace, 0, params->start);
+
+	if ((params->checkpoint = malloc(mm_state_size())) == NULL)
+		unix_error("malloc failed in make_checkpoint");
+	mm_save_state(params->checkpoint);
+	if ((params->blocks = malloc(len)) == NULL)
+		unix_error("malloc failed in make_checkpoint");
+	memcpy(params->blocks, trace->blocks, len);
+}
+
+/*
+ * free_checkpoint - Free the storage used by make_checkpoint
+ */
+static void free_checkpoint(speed_t *params)
+{
+	free(params->checkpoint);
+	free(params->blocks);
+	params->checkpoint = NULL;
+}
+
+/*
+ * eval_mm_profile - Replay the trace once, window ops at a time, and
+ *    print the throughput of each window next to the live bytes, heap
+ *    size and free list occupancy at its end. Only the ops are timed.
+ */
+static void eval_mm_profile(trace_t *trace, int tracenum, int window)
+{
+	int i, start, end, index, size;
+	size_t live = 0;
+	double secs;
+	mm_free_stats_t fs;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_profile");
+
+	printf("\nWindow profile for trace %d:\n", tracenum);
+	printf("%8s %8s %9s %9s %9s %9s %8s\n",
+		   "op", "Kops", "live KB", "heap KB", "free blks", "free KB", "longest");
+	for (start = 0; start < trace->num_ops; start = end)
+	{
+		end = (start + window < trace->num_ops) ? start + window : trace->num_ops;
+		secs = ftimer_now();
+		eval_mm_ops(trace, start, end);
+		secs = ftimer_now() - secs;
+
+		/* Track the live payload bytes, outside the timed stretch */
+		for (i = start; i < end; i++)
+		{
+			index = trace->ops[i].index;
+			size = trace->ops[i].size;
+			switch (trace->ops[i].type)
+			{
+			case ALLOC:
+				live += size;
+				trace->block_sizes[index] = size;
+				break;
+			case REALLOC:
+				live += size - trace->block_sizes[index];
+				trace->block_sizes[index] = size;
+				break;
+			case FREE:
+				live -= trace->block_sizes[index];
+				break;
+			}
+		}
+
+		mm_get_free_stats(&fs);
+		printf("%8d %8.0f %9.1f %9.1f %9lu %9.1f %8lu\n",
+			   start, (secs > 0) ? (end - start) / secs / 1e3 : 0.0,
+			   live / 1024.0, mem_heapsize() / 1024.0,
+			   fs.blocks, fs.bytes / 1024.0, fs.max_list);
+	}
+}
+
+/*
+ * eval_mm_overhead - Replay the trace and break the heap down into
+ *    payload and each kind of overhead twice: when the heap first reaches
+ *    the peak size of the util run, and after the last op
+ */
+static void eval_mm_overhead(trace_t *trace, int tracenum, stats_t *stats)
+{
+	int i, index, size, peaked = 0;
+	char *p;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in eval_mm_overhead");
+	for (i = 0; i < trace->num_ids; i++)
+		trace->block_sizes[i] = 0;
 
-	/* Interpret each trace request */
 	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC: /* mm_malloc */
+			if ((p = mm_malloc(size)) == NULL)
+				app_error("mm_malloc failed in eval_mm_overhead");
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
+			break;
+
+		case REALLOC: /* mm_realloc */
+			if ((p = mm_realloc(trace->blocks[index], size)) == NULL)
+				app_error("mm_realloc failed in eval_mm_overhead");
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
+			break;
+
+		case FREE: /* mm_free */
+			mm_free(trace->blocks[index]);
+			trace->block_sizes[index] = 0;
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_mm_overhead");
+		}
+		if (!peaked && mem_heapsize() >= stats->heap)
+		{
+			heap_overhead(trace, &stats->ov_peak);
+			peaked = 1;
+		}
+	}
+	heap_overhead(trace, &stats->ov_final);
+}
+
+/*
+ * heap_overhead - Walk the mm heap and sort its bytes into ov, using the
+ *    sizes the trace asked for its live blocks
+ */
+static void heap_overhead(trace_t *trace, overhead_t *ov)
+{
+	walk_t w;
+	int i;
+
+	if ((w.live = malloc((trace->num_ids + 1) * sizeof(live_t))) == NULL)
+		unix_error("malloc failed in heap_overhead");
+	for (i = 0, w.n = 0; i < trace->num_ids; i++)
+		if (trace->block_sizes[i] > 0)
+		{
+			w.live[w.n].p = trace->blocks[i];
+			w.live[w.n++].size = trace->block_sizes[i];
+		}
+	qsort(w.live, w.n, sizeof(live_t), cmp_live);
+	w.next = 0;
+	w.walked = 0;
+	w.ov = ov;
+	memset(ov, 0, sizeof(*ov));
+
+	mm_walk_heap(heap_block, &w);
+	ov->heap = mem_heapsize();
+	ov->other += ov->heap - w.walked;
+	free(w.live);
+}
+
+/*
+ * heap_block - Sort one block of the heap into a walk's overhead_t. Of an
+ *    allocated block, the payload is what the trace asked for, rounding
+ *    is what mm_block_size adds to that, and the sliver the rest.
+ */
+static void heap_block(const mm_block_t *blk, void *arg)
+{
+	walk_t *w = (walk_t *)arg;
+	overhead_t *ov = w->ov;
+	size_t asize, size;
+
+	w->walked += blk->size;
+	if (!blk->alloc)
+	{
+		ov->free[blk->bin] += blk->size;
+		return;
+	}
+	while (w->next < w->n && w->live[w->next].p < (char *)blk->bp)
+		w->next++;
+	if (w->next == w->n || w->live[w->next].p != (char *)blk->bp)
+	{
+		/* Allocated, but not by the trace */
+		ov->other += blk->size;
+		return;
+	}
+	size = w->live[w->next++].size;
+	asize = mm_block_size(size);
+	if (asize > blk->size)
+		asize = blk->size;
+	ov->payload += size;
+	ov->meta += blk->overhead;
+	ov->rounding += asize - blk->overhead - size;
+	ov->sliver += blk->size - asize;
+}
+
+/*
+ * cmp_live - Order live blocks by address, for qsort
+ */
+static int cmp_live(const void *a, const void *b)
+{
+	char *pa = ((const live_t *)a)->p;
+	char *pb = ((const live_t *)b)->p;
+
+	return (pa > pb) - (pa < pb);
+}
+
+/*
+ * eval_mm_ops - Run trace ops start..end-1 through the mm package
+ */
+static void eval_mm_ops(trace_t *trace, int start, int end)
+{
+	int i, index, size, newsize;
+	char *p, *newp, *oldp, *block;
+
+	/* Interpret each trace request */
+	for (i = start; i < end; i++)
 		switch (trace->ops[i].type)
 		{
 
@@ -961,6 +1571,78 @@ static void eval_libc_speed(void *ptr)
 	}
 }
 
+/*
+ * null_malloc, null_realloc, null_free - An allocator that does nothing
+ *    but bump a pointer through null_heap (wrapping around, since the
+ *    blocks are never touched) and never frees. Timing mdriver's replay
+ *    loop with it gives the cost of the loop itself. They are kept out of
+ *    line so that, like mm.c's, every request is a real call.
+ */
+static __attribute__((noinline)) void *null_malloc(size_t size)
+{
+	void *p;
+
+	size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	if (null_brk + size > NULL_HEAP)
+		null_brk = 0;
+	p = null_heap + null_brk;
+	null_brk += size;
+	return p;
+}
+
+static __attribute__((noinline)) void *null_realloc(void *ptr, size_t size)
+{
+	return null_malloc(size);
+}
+
+static __attribute__((noinline)) void null_free(void *ptr)
+{
+}
+
+/*
+ * eval_null_speed - The loop of eval_mm_speed, over the same ops, with
+ *    the null allocator in place of mm.c
+ */
+static void eval_null_speed(void *ptr)
+{
+	speed_t *params = (speed_t *)ptr;
+	trace_t *trace = params->trace;
+	int i, index, size, newsize;
+	char *p, *newp, *oldp, *block;
+
+	null_brk = 0;
+	for (i = params->start; i < params->end; i++)
+		switch (trace->ops[i].type)
+		{
+
+		case ALLOC: /* null_malloc */
+			index = trace->ops[i].index;
+			size = trace->ops[i].size;
+			if ((p = null_malloc(size)) == NULL)
+				app_error("null_malloc error in eval_null_speed");
+			trace->blocks[index] = p;
+			break;
+
+		case REALLOC: /* null_realloc */
+			index = trace->ops[i].index;
+			newsize = trace->ops[i].size;
+			oldp = trace->blocks[index];
+			if ((newp = null_realloc(oldp, newsize)) == NULL)
+				app_error("null_realloc error in eval_null_speed");
+			trace->blocks[index] = newp;
+			break;
+
+		case FREE: /* null_free */
+			index = trace->ops[i].index;
+			block = trace->blocks[index];
+			null_free(block);
+			break;
+
+		default:
+			app_error("Nonexistent request type in eval_null_speed");
+		}
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -1026,6 +1708,373 @@ static void printresults(int n, stats_t *stats)
 	}
 }
 
+/*
+ * printfitstats - prints the find_fit search lengths for the mm package
+ */
+static void printfitstats(int n, stats_t *stats)
+{
+	int i;
+	double searches = 0;
+	double probes = 0;
+	unsigned long max_probes = 0;
+
+	printf("%5s%10s%10s%10s\n", "trace", "searches", "avg", "max");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid)
+		{
+			printf("%2d%13lu%10.2f%10lu\n",
+				   i,
+				   stats[i].fit.searches,
+				   stats[i].fit.searches ? (double)stats[i].fit.probes / stats[i].fit.searches : 0.0,
+				   stats[i].fit.max_probes);
+			searches += stats[i].fit.searches;
+			probes += stats[i].fit.probes;
+			if (stats[i].fit.max_probes > max_probes)
+				max_probes = stats[i].fit.max_probes;
+		}
+		else
+		{
+			printf("%2d%13s%10s%10s\n", i, "-", "-", "-");
+		}
+	}
+	printf("%5s%10.0f%10.2f%10lu\n",
+		   "Total",
+		   searches,
+		   searches ? probes / searches : 0.0,
+		   max_probes);
+}
+
+/*
+ * printboundstats - Print mm's peak heap next to the offline bounds on
+ *    the heap each trace needs. The least heap any non-moving allocator
+ *    could use lies between "lower" and "packed", so "vs packed" is how
+ *    close mm comes to an offline packing of the same trace.
+ */
+static void printboundstats(int n, stats_t *stats)
+{
+	int i;
+	double heap = 0;
+	double lower = 0;
+	double packed = 0;
+
+	printf("%5s%10s%10s%10s%11s%11s\n", "trace", "mm heap", "lower", "packed",
+		   "vs lower", "vs packed");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid)
+		{
+			printf("%2d%13.1f%10.1f%10.1f%10.0f%%%10.0f%%\n",
+				   i,
+				   stats[i].heap / 1024.0,
+				   stats[i].bound.lower / 1024.0,
+				   stats[i].bound.packed / 1024.0,
+				   100.0 * stats[i].bound.lower / stats[i].heap,
+				   100.0 * stats[i].bound.packed / stats[i].heap);
+			heap += stats[i].heap;
+			lower += stats[i].bound.lower;
+			packed += stats[i].bound.packed;
+		}
+		else
+		{
+			printf("%2d%13s%10s%10s%11s%11s\n", i, "-", "-", "-", "-", "-");
+		}
+	}
+	if (heap > 0)
+		printf("%5s%10.1f%10.1f%10.1f%10.0f%%%10.0f%%\n",
+			   "Total",
+			   heap / 1024.0,
+			   lower / 1024.0,
+			   packed / 1024.0,
+			   100.0 * lower / heap,
+			   100.0 * packed / heap);
+}
+
+/*
+ * printoverheadstats - Print, for the heap at its peak and at the end of
+ *    each trace, the share of the live payload and of each overhead, and
+ *    the free bytes on each of mm's bins
+ */
+static void printoverheadstats(int n, stats_t *stats)
+{
+	int i, j, k;
+	overhead_t *ov;
+	size_t free;
+	double heap;
+
+	printf("mm heap by kind of byte (%% of heap):\n");
+	printf("%5s%7s%10s%9s%7s%8s%8s%8s%7s\n", "trace", "", "heap KB", "payload",
+		   "round", "sliver", "hdr/ftr", "free", "other");
+	for (i = 0; i < n; i++)
+		for (k = 0; k < 2; k++)
+		{
+			ov = k ? &stats[i].ov_final : &stats[i].ov_peak;
+			if (!stats[i].valid || ov->heap == 0)
+			{
+				printf("%2d%10s%10s%9s%7s%8s%8s%8s%7s\n", i, k ? "final" : "peak",
+					   "-", "-", "-", "-", "-", "-", "-");
+				continue;
+			}
+			for (j = 0, free = 0; j < MM_NBINS; j++)
+				free += ov->free[j];
+			heap = ov->heap / 100.0;
+			printf("%2d%10s%10.1f%8.1f%%%6.1f%%%7.1f%%%7.1f%%%7.1f%%%6.1f%%\n",
+				   i, k ? "final" : "peak", ov->heap / 1024.0,
+				   ov->payload / heap, ov->rounding / heap, ov->sliver / heap,
+				   ov->meta / heap, free / heap, ov->other / heap);
+		}
+
+	printf("\nFree KB on each mm bin:\n");
+	printf("%5s%7s", "trace", "");
+	for (j = 0; j < MM_NBINS; j++)
+		printf("%7s%d", "bin", j);
+	printf("\n");
+	for (i = 0; i < n; i++)
+		for (k = 0; k < 2; k++)
+		{
+			ov = k ? &stats[i].ov_final : &stats[i].ov_peak;
+			printf("%2d%10s", i, k ? "final" : "peak");
+			for (j = 0; j < MM_NBINS; j++)
+				if (stats[i].valid && ov->heap > 0)
+					printf("%8.1f", ov->free[j] / 1024.0);
+				else
+					printf("%8s", "-");
+			printf("\n");
+		}
+}
+
+/*
+ * printnetstats - Print mm's time per op as measured ("raw"), the time
+ *    per op of the replay loop alone ("loop", with the null allocator),
+ *    and their difference ("net"), the time spent in mm.c itself.
+ */
+static void printnetstats(int n, stats_t *stats)
+{
+	int i;
+	double ops = 0;
+	double secs = 0;
+	double null_secs = 0;
+
+	printf("%5s%10s%10s%10s%10s%10s\n", "trace", "ops", "raw ns", "loop ns",
+		   "net ns", "net Kops");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid)
+		{
+			printf("%2d%13.0f%10.1f%10.1f%10.1f%10.0f\n",
+				   i,
+				   stats[i].ops,
+				   1e9 * stats[i].secs / stats[i].ops,
+				   1e9 * stats[i].null_secs / stats[i].ops,
+				   1e9 * (stats[i].secs - stats[i].null_secs) / stats[i].ops,
+				   stats[i].ops / 1e3 / (stats[i].secs - stats[i].null_secs));
+			ops += stats[i].ops;
+			secs += stats[i].secs;
+			null_secs += stats[i].null_secs;
+		}
+		else
+		{
+			printf("%2d%13s%10s%10s%10s%10s\n", i, "-", "-", "-", "-", "-");
+		}
+	}
+	if (ops > 0)
+		printf("%5s%10.0f%10.1f%10.1f%10.1f%10.0f\n",
+			   "Total",
+			   ops,
+			   1e9 * secs / ops,
+			   1e9 * null_secs / ops,
+			   1e9 * (secs - null_secs) / ops,
+			   ops / 1e3 / (secs - null_secs));
+}
+
+/*
+ * printtimingstats - Print the robust timing behind each trace's
+ *    throughput: the runs it took, the throughput of the median run, and
+ *    the throughputs at the ends of the median's 95% interval
+ */
+static void printtimingstats(int n, stats_t *stats)
+{
+	int i;
+	ftimer_result_t *t;
+
+	printf("%5s%10s%10s%10s%10s%8s\n", "trace", "runs", "Kops", "lo", "hi", "+-");
+	for (i = 0; i < n; i++)
+	{
+		t = &stats[i].timing;
+		if (stats[i].valid && t->median > 0)
+		{
+			printf("%2d%13d%10.0f%10.0f%10.0f%7.1f%%\n",
+				   i,
+				   t->runs,
+				   stats[i].ops / 1e3 / t->median,
+				   stats[i].ops / 1e3 / t->hi,
+				   stats[i].ops / 1e3 / t->lo,
+				   100.0 * (t->hi - t->lo) / 2 / t->median);
+		}
+		else
+		{
+			printf("%2d%13s%10s%10s%10s%8s\n", i, "-", "-", "-", "-", "-");
+		}
+	}
+}
+
+/*
+ * printcoldstats - Print each trace's throughput with warm caches (as
+ *    scored) and with the caches flushed before every run, and the
+ *    slowdown the cold runs show
+ */
+static void printcoldstats(int n, stats_t *stats)
+{
+	int i;
+	double ops = 0;
+	double secs = 0;
+	double cold_secs = 0;
+
+	printf("%5s%10s%10s%10s%10s\n", "trace", "ops", "warm Kops", "cold Kops",
+		   "cold/warm");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid && stats[i].secs > 0 && stats[i].cold_secs > 0)
+		{
+			printf("%2d%13.0f%10.0f%10.0f%9.2fx\n",
+				   i,
+				   stats[i].ops,
+				   stats[i].ops / 1e3 / stats[i].secs,
+				   stats[i].ops / 1e3 / stats[i].cold_secs,
+				   stats[i].cold_secs / stats[i].secs);
+			ops += stats[i].ops;
+			secs += stats[i].secs;
+			cold_secs += stats[i].cold_secs;
+		}
+		else
+		{
+			printf("%2d%13s%10s%10s%10s\n", i, "-", "-", "-", "-");
+		}
+	}
+	if (ops > 0)
+		printf("%5s%10.0f%10.0f%10.0f%9.2fx\n",
+			   "Total",
+			   ops,
+			   ops / 1e3 / secs,
+			   ops / 1e3 / cold_secs,
+			   cold_secs / secs);
+}
+
+/*
+ * printtouchstats - Print each trace's throughput as scored ("mm") and
+ *    under the payload-touching replay ("touch"), and the difference per
+ *    op: the application's own time, which depends on how well mm placed
+ *    the blocks it works on
+ */
+static void printtouchstats(int n, stats_t *stats)
+{
+	int i;
+	double ops = 0;
+	double secs = 0;
+	double touch_secs = 0;
+
+	printf("%5s%10s%10s%11s%10s%8s\n", "trace", "ops", "mm Kops", "touch Kops",
+		   "app ns", "app");
+	for (i = 0; i < n; i++)
+	{
+		if (stats[i].valid && stats[i].secs > 0 && stats[i].touch_secs > 0)
+		{
+			printf("%2d%13.0f%10.0f%11.0f%10.1f%7.1f%%\n",
+				   i,
+				   stats[i].ops,
+				   stats[i].ops / 1e3 / stats[i].secs,
+				   stats[i].ops / 1e3 / stats[i].touch_secs,
+				   1e9 * (stats[i].touch_secs - stats[i].secs) / stats[i].ops,
+				   100.0 * (stats[i].touch_secs - stats[i].secs) / stats[i].touch_secs);
+			ops += stats[i].ops;
+			secs += stats[i].secs;
+			touch_secs += stats[i].touch_secs;
+		}
+		else
+		{
+			printf("%2d%13s%10s%11s%10s%8s\n", i, "-", "-", "-", "-", "-");
+		}
+	}
+	if (ops > 0)
+		printf("%5s%10.0f%10.0f%11.0f%10.1f%7.1f%%\n",
+			   "Total",
+			   ops,
+			   ops / 1e3 / secs,
+			   ops / 1e3 / touch_secs,
+			   1e9 * (touch_secs - secs) / ops,
+			   100.0 * (touch_secs - secs) / touch_secs);
+}
+
+/*
+ * weighted_scores - Average mm's utilization and its throughput over
+ *    libc's across the traces, weighting each trace by the weight in its
+ *    header. Traces with no positive weight count once if none has one.
+ */
+static void weighted_scores(int n, stats_t *mm_stats, stats_t *libc_stats,
+							double *util, double *ratio)
+{
+	int i, w;
+	double weights = 0;
+	int any = 0;
+
+	for (i = 0; i < n; i++)
+		any |= (mm_stats[i].weight > 0);
+	*util = 0;
+	*ratio = 0;
+	for (i = 0; i < n; i++)
+	{
+		w = any ? mm_stats[i].weight : 1;
+		if (w <= 0 || !mm_stats[i].valid || !libc_stats[i].valid ||
+			mm_stats[i].secs <= 0 || libc_stats[i].secs <= 0)
+			continue;
+		*util += w * mm_stats[i].util;
+		*ratio += w * (mm_stats[i].ops / mm_stats[i].secs) /
+				  (libc_stats[i].ops / libc_stats[i].secs);
+		weights += w;
+	}
+	if (weights > 0)
+	{
+		*util /= weights;
+		*ratio /= weights;
+	}
+}
+
+/*
+ * printlibcstats - Print each trace's weight and the throughput of mm
+ *    and of libc on it, with their ratio, and the weighted averages
+ *    behind the uncapped index
+ */
+static void printlibcstats(int n, stats_t *mm_stats, stats_t *libc_stats)
+{
+	int i;
+	double util, ratio;
+
+	printf("%5s%8s%7s%10s%10s%9s\n", "trace", "weight", "util", "mm Kops",
+		   "libc Kops", "mm/libc");
+	for (i = 0; i < n; i++)
+	{
+		if (mm_stats[i].valid && libc_stats[i].valid &&
+			mm_stats[i].secs > 0 && libc_stats[i].secs > 0)
+		{
+			printf("%2d%11d%6.0f%%%10.0f%10.0f%9.2f\n",
+				   i,
+				   mm_stats[i].weight,
+				   100 * mm_stats[i].util,
+				   mm_stats[i].ops / 1e3 / mm_stats[i].secs,
+				   libc_stats[i].ops / 1e3 / libc_stats[i].secs,
+				   (mm_stats[i].ops / mm_stats[i].secs) /
+					   (libc_stats[i].ops / libc_stats[i].secs));
+		}
+		else
+		{
+			printf("%2d%11d%7s%10s%10s%9s\n", i, mm_stats[i].weight,
+				   "-", "-", "-", "-");
+		}
+	}
+	weighted_scores(n, mm_stats, libc_stats, &util, &ratio);
+	printf("%-13s%6.0f%%%20s%9.2f\n", "Weighted", 100 * util, "", ratio);
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1058,14 +2107,32 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+	fprintf(stderr, "Usage: mdriver [-hvValLcnsORSB] [-f <file>] [-t <dir>] [-F <policy>] [-K <n>]\n");
+	fprintf(stderr, "               [-C <op>] [-E <op>] [-w <n>] [-W <n>] [-I <pct>] [-P <cpu>] [-T <n>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-a         Don't check the team structure.\n");
+	fprintf(stderr, "\t-B         Compare the mm heap with offline bounds.\n");
+	fprintf(stderr, "\t-c         Also time mm with the caches flushed before each run.\n");
+	fprintf(stderr, "\t-C <op>    Time mm from a heap checkpoint taken at <op>.\n");
+	fprintf(stderr, "\t-E <op>    Stop timing mm at <op>.\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-F <pol>   mm placement policy: best (default), first or next.\n");
 	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
 	fprintf(stderr, "\t-h         Print this message.\n");
-	fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+	fprintf(stderr, "\t-I <pct>   Time until the 95%% interval is within <pct>%% (implies -R).\n");
+	fprintf(stderr, "\t-K <n>     Give up on a bin after <n> probes (0 = never).\n");
+	fprintf(stderr, "\t-l         Run libc malloc as well, and give an uncapped index.\n");
+	fprintf(stderr, "\t-L         Cap throughput at libc's, measured here (implies -l).\n");
+	fprintf(stderr, "\t-n         Report mm time net of the replay loop (null allocator).\n");
+	fprintf(stderr, "\t-O         Break the mm heap down into payload and overheads.\n");
+	fprintf(stderr, "\t-P <cpu>   Pin the driver to <cpu> while it runs.\n");
+	fprintf(stderr, "\t-R         Time with warmup runs and report 95%% intervals.\n");
+	fprintf(stderr, "\t-s         Check payloads at their ends and at random words only.\n");
+	fprintf(stderr, "\t-S         Put the mm heap in a shared memory mapping.\n");
 	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr, "\t-T <n>     Also time mm with payloads written, walking the last <n> blocks.\n");
 	fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
+	fprintf(stderr, "\t-w <n>     Profile mm throughput in windows of <n> ops.\n");
+	fprintf(stderr, "\t-W <n>     Run <n> untimed warmup runs first (implies -R).\n");
 	fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
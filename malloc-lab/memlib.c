@@ -1,23 +1,73 @@
-/*
+/* 
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ *            The heap is either private (mem_init) or lives in a shared
+ *            mapping that several processes can map at different
+ *            addresses (mem_init_shared, mem_attach_shared), or in a
+ *            file that keeps it across restarts (mem_init_file). The brk
+ *            is kept as an offset in a mem_hdr_t so that a shared mapping
+ *            carries it along.
  */
+#define _GNU_SOURCE /* for memfd_create */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <errno.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* Heap extent, stored in the first page of a shared mapping */
+typedef struct {
+    size_t brk;      /* heap size in bytes */
+    size_t peak_brk; /* highest brk since the last reset */
+} mem_hdr_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_hdr_t mem_local;  /* heap extent of a private heap */
+static mem_hdr_t *mem_hdr = &mem_local;
+static char *mem_map_addr;   /* shared mapping (NULL for a private heap) */
+static size_t mem_map_len;   /* its length: one header page + MAX_HEAP */
+static int mem_fd = -1;      /* file descriptor behind the shared mapping */
+
+#define mem_brk (mem_start_brk + mem_hdr->brk)
+
+/* 
+ * mem_map_shared - map the shared object fd as the heap. If reset is set,
+ *    size it and start with an empty heap, otherwise keep its contents.
+ */
+static void mem_map_shared(int fd, int reset)
+{
+    size_t pagesize = mem_pagesize();
+
+    mem_map_len = pagesize + MAX_HEAP;
+    if (reset && ftruncate(fd, mem_map_len) < 0) {
+	fprintf(stderr, "mem_map_shared: ftruncate error\n");
+	exit(1);
+    }
+    mem_map_addr = mmap(NULL, mem_map_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+    if (mem_map_addr == MAP_FAILED) {
+	fprintf(stderr, "mem_map_shared: mmap error\n");
+	exit(1);
+    }
+
+    mem_fd = fd;
+    mem_hdr = (mem_hdr_t *)mem_map_addr;
+    mem_start_brk = mem_map_addr + pagesize;
+    mem_max_addr = mem_start_brk + MAX_HEAP;
+    if (reset)
+	mem_reset_brk();
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -31,7 +81,73 @@ void mem_init(void)
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_reset_brk();                          /* heap is empty initially */
+}
+
+/* 
+ * mem_init_shared - initialize the memory system model over a shared
+ *    mapping: the POSIX shared memory object name, or an anonymous memfd
+ *    (shared with children across fork) if name is NULL.
+ */
+void mem_init_shared(const char *name)
+{
+    int fd;
+
+    if (name != NULL)
+	fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    else
+	fd = memfd_create("mm_heap", 0);
+    if (fd < 0) {
+	fprintf(stderr, "mem_init_shared: %s\n", strerror(errno));
+	exit(1);
+    }
+    mem_map_shared(fd, 1);
+}
+
+/* 
+ * mem_attach_shared - map the existing shared heap name without resetting it
+ */
+void mem_attach_shared(const char *name)
+{
+    int fd;
+
+    if ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+	fprintf(stderr, "mem_attach_shared: %s\n", strerror(errno));
+	exit(1);
+    }
+    mem_map_shared(fd, 0);
+}
+
+/* 
+ * mem_init_file - initialize the memory system model over the file path,
+ *    creating it if needed. A file that is not empty keeps its heap, and
+ *    must have been created with the same MAX_HEAP.
+ */
+void mem_init_file(const char *path)
+{
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0 || fstat(fd, &st) < 0) {
+	fprintf(stderr, "mem_init_file: %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    if (st.st_size != 0 && (size_t)st.st_size != mem_pagesize() + MAX_HEAP) {
+	fprintf(stderr, "mem_init_file: %s: not a heap file of this size\n", path);
+	exit(1);
+    }
+    mem_map_shared(fd, st.st_size == 0);
+}
+
+/* 
+ * mem_sync - write a file-backed heap out to its file. Returns -1 on
+ *    error, 0 otherwise (including for heaps that are not file-backed).
+ */
+int mem_sync(void)
+{
+    if (mem_map_addr == NULL)
+	return 0;
+    return msync(mem_map_addr, mem_pagesize() + mem_hdr->brk, MS_SYNC);
 }
 
 /* 
@@ -39,36 +155,79 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_map_addr != NULL) {
+	munmap(mem_map_addr, mem_map_len);
+	close(mem_fd);
+	mem_map_addr = NULL;
+	mem_fd = -1;
+	mem_hdr = &mem_local;
+    }
+    else
+	free(mem_start_brk);
 }
 
-/*
+/* 
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_hdr->brk = 0;
+    mem_hdr->peak_brk = 0;
+}
+
+/* 
+ * mem_state_size - bytes needed by mem_save_state for the current heap
+ */
+size_t mem_state_size(void)
+{
+    return sizeof(mem_hdr_t) + mem_hdr->brk;
+}
+
+/* 
+ * mem_save_state - copy the brk and the heap contents to buf
+ */
+void mem_save_state(void *buf)
+{
+    memcpy(buf, mem_hdr, sizeof(mem_hdr_t));
+    memcpy((char *)buf + sizeof(mem_hdr_t), mem_start_brk, mem_hdr->brk);
+}
+
+/* 
+ * mem_load_state - put back a heap saved by mem_save_state in this
+ *    process. The heap keeps its address, so pointers into it stay valid.
+ */
+void mem_load_state(const void *buf)
+{
+    memcpy(mem_hdr, buf, sizeof(mem_hdr_t));
+    memcpy(mem_start_brk, (const char *)buf + sizeof(mem_hdr_t), mem_hdr->brk);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, but never below its first byte.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((incr < 0) && ((old_brk + incr) < mem_start_brk)) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Heap shrunk below its start...\n");
+	return (void *)-1;
+    }
+    if ((old_brk + incr) > mem_max_addr) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    mem_hdr->brk += incr;
+    if (mem_hdr->brk > mem_hdr->peak_brk)
+	mem_hdr->peak_brk = mem_hdr->brk;
     return (void *)old_brk;
 }
 
-/*
+/* 
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo()
@@ -84,15 +243,24 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
-/*
+/* 
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_hdr->brk;
 }
 
-/*
+/* 
+ * mem_heappeak() - returns the largest heap size in bytes since the
+ *    last reset. This is the high water mark even if the heap shrank.
+ */
+size_t mem_heappeak() 
+{
+    return mem_hdr->peak_brk;
+}
+
+/* 
  * mem_pagesize() - returns the page size of the system
  */
 size_t mem_pagesize()
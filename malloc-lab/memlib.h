@@ -1,11 +1,19 @@
 #include <unistd.h>
 
 void mem_init(void);               
+void mem_init_shared(const char *name);
+void mem_attach_shared(const char *name);
+void mem_init_file(const char *path);
+int mem_sync(void);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_heappeak(void);
 size_t mem_pagesize(void);
+size_t mem_state_size(void);
+void mem_save_state(void *buf);
+void mem_load_state(const void *buf);
 
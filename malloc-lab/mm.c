@@ -5,6 +5,43 @@
  * based on block size. LIFO policy is used for insertion within each list.
  *
  * NOTE: 64-bit environment compatible (WSIZE=8, DSIZE=16, 16-byte alignment).
+ *
+ * find_fit supports three placement policies selected with
+ * mm_set_fit_policy: best fit over size-ordered bins, address-ordered
+ * first fit, and next fit with a rover per bin. A probe bound K caps the
+ * blocks examined per bin, trading utilization for search latency; the
+ * last bin is kept size-ordered under every policy so that a capped search
+ * there can still fall back on its largest blocks.
+ *
+ * With BITMAP set, side bitmaps with one bit per 16-byte granule record
+ * where blocks start and which are allocated, so coalesce can find its
+ * neighbours without reading their boundary tags.
+ *
+ * Blocks allocated through the handle API (mm_halloc) may be moved.
+ * mm_compact slides unpinned handle blocks toward the low end of the heap
+ * a bounded number of blocks at a time, then trims the free top.
+ *
+ * With BG_MAINT set, mm_free only pushes the block onto a lock-free
+ * queue. A background thread drains the queue under the heap lock,
+ * coalescing and reinserting the blocks, and returns the interior pages
+ * of large free blocks to the OS once it goes idle. mm_malloc drains the
+ * queue itself before it extends the heap.
+ *
+ * mm_set_budget caps the heap size. Growing past the soft watermark runs
+ * the pressure callback, retries the fit, and purges free pages. Growing
+ * past the hard one runs the callback, then compacts and trims the heap,
+ * and only fails if the request still does not fit.
+ *
+ * The per-heap state lives in a heap_hdr_t. With SHARED_HEAP set that
+ * header sits at the bottom of the heap together with a robust
+ * process-shared lock, and free-list links and list heads become heap
+ * offsets rather than pointers, so processes that map the same memlib
+ * region at different addresses can all allocate from it (see mm_attach).
+ *
+ * The same layout makes a file-backed heap (mem_init_file) persistent:
+ * after a restart mm_recover checks the heap with mm_check and picks it
+ * up where the last process left it, and mm_get_root returns the block
+ * the application registered as the entry point to its data.
  */
 
 #include <stdio.h>
@@ -12,10 +49,25 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "mm.h"
 #include "memlib.h"
 
+#ifndef BG_MAINT
+#define BG_MAINT 0 /* Set to 1 to free through a maintenance thread */
+#endif
+
+#ifndef SHARED_HEAP
+#define SHARED_HEAP 0 /* Set to 1 to share the heap between processes */
+#endif
+
+#if BG_MAINT || SHARED_HEAP
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -53,6 +105,7 @@ team_t team = {
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0xF)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_MOVABLE(p) (GET(p) & 0x2) /* Allocated through mm_halloc */
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -67,23 +120,196 @@ team_t team = {
 #define PREV_FREE_BLKP(bp) ((char *)(bp))         // Address of PRED pointer
 #define NEXT_FREE_BLKP(bp) ((char *)(bp) + WSIZE) // Address of SUCC pointer
 
-#define GET_PRED(bp) (*(char **)(PREV_FREE_BLKP(bp)))
-#define GET_SUCC(bp) (*(char **)(NEXT_FREE_BLKP(bp)))
-#define SET_PRED(bp, pred) (*(char **)(PREV_FREE_BLKP(bp)) = (pred))
-#define SET_SUCC(bp, succ) (*(char **)(NEXT_FREE_BLKP(bp)) = (succ))
+/*
+ * A shared heap may be mapped at a different address in every process, so
+ * its links are offsets from heap_base, with 0 (the padding word) as NULL.
+ * A private heap stores plain pointers and saves the arithmetic.
+ */
+#if SHARED_HEAP
+#define TO_OFF(p) ((p) ? (size_t)((char *)(p) - heap_base) : 0)
+#define TO_PTR(off) ((off) ? heap_base + (off) : NULL)
+#else
+#define TO_OFF(p) ((size_t)(p))
+#define TO_PTR(off) ((char *)(off))
+#endif
+
+#define GET_PRED(bp) TO_PTR(GET(PREV_FREE_BLKP(bp)))
+#define GET_SUCC(bp) TO_PTR(GET(NEXT_FREE_BLKP(bp)))
+#define SET_PRED(bp, pred) PUT(PREV_FREE_BLKP(bp), TO_OFF(pred))
+#define SET_SUCC(bp, succ) PUT(NEXT_FREE_BLKP(bp), TO_OFF(succ))
+
+/*
+ * Free-list prefetching: while one free block is examined, prefetch the
+ * header of the next block in its list (PREFETCH_DIST 1; 0 turns it off).
+ * Going further would mean loading the next block's successor link, which
+ * is the very miss the prefetch is meant to hide.
+ */
+#ifndef PREFETCH_DIST
+#define PREFETCH_DIST 1
+#endif
+
+#if PREFETCH_DIST > 1
+#error "PREFETCH_DIST must be 0 or 1"
+#elif PREFETCH_DIST == 1
+#define PREFETCH_SUCC(bp)                           \
+    do                                              \
+    {                                               \
+        if (GET_SUCC(bp) != NULL)                   \
+            __builtin_prefetch(HDRP(GET_SUCC(bp))); \
+    } while (0)
+#else
+#define PREFETCH_SUCC(bp) ((void)0)
+#endif
+
+#define N_LISTS MM_NBINS /* Number of segregation lists */
+
+/*
+ * Per-heap state. Every process that uses the heap must agree on it, so
+ * with SHARED_HEAP it is stored at the bottom of the heap itself.
+ */
+typedef struct
+{
+    size_t seg_list[N_LISTS]; /* Segregated list heads (TO_OFF) */
+    size_t rover[N_LISTS];    /* Next-fit rover for each bin (TO_OFF) */
+    size_t last_tail;         /* Largest block of the last bin (TO_OFF) */
+    int fit_policy;           /* One of MM_FIT_xxx */
+    int fit_max_probes;       /* Per-bin probe bound (0 = unbounded) */
+    size_t root;              /* Application root block (TO_OFF) */
+#if SHARED_HEAP
+    size_t magic;         /* HEAP_MAGIC once mm_init has built the heap */
+    pthread_mutex_t lock; /* Robust, process-shared heap lock */
+#endif
+} heap_hdr_t;
+
+#if SHARED_HEAP
+#define HEAP_HDR_SIZE ALIGN(sizeof(heap_hdr_t))
+#define HEAP_MAGIC 0x6d6d686561700002UL
+#else
+#define HEAP_HDR_SIZE 0
+#endif
+
+#define LIST_HEAD(i) TO_PTR(hp->seg_list[i])
+#define SET_LIST_HEAD(i, bp) (hp->seg_list[i] = TO_OFF(bp))
+#define ROVER(i) TO_PTR(hp->rover[i])
+#define SET_ROVER(i, bp) (hp->rover[i] = TO_OFF(bp))
+#define LAST_TAIL() TO_PTR(hp->last_tail)
+#define SET_LAST_TAIL(bp) (hp->last_tail = TO_OFF(bp))
+
+static heap_hdr_t heap_local;    /* Heap state for a private heap */
+static heap_hdr_t *hp = &heap_local;
+static char *heap_listp;         /* Pointer to the first block */
+static char *heap_base;          /* First byte of the memlib region */
+
+/* Placement policy and fit search telemetry */
+static int req_policy = MM_FIT_BEST; /* Requested by mm_set_fit_policy */
+static int req_max_probes = 0;
+static mm_fit_stats_t fit_stats; /* Reset by mm_init */
 
-#define N_LISTS 10              /* Number of segregation lists */
-static char *heap_listp;        /* Pointer to the first block */
-static void *seg_list[N_LISTS]; /* Array of segregated list heads */
+/* Deferred frees and the heap lock */
+#if BG_MAINT
+#define BG_PERIOD_NS 100000 /* Maintenance thread wakes every 100 us */
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *free_queue; /* Blocks awaiting free, linked through their payloads */
+static int bg_started;   /* Maintenance thread is running */
+
+#define LOCK() pthread_mutex_lock(&heap_lock)
+#define UNLOCK() pthread_mutex_unlock(&heap_lock)
+#elif SHARED_HEAP
+#define LOCK() shared_lock()
+#define UNLOCK() pthread_mutex_unlock(&hp->lock)
+#else
+#define LOCK() ((void)0)
+#define UNLOCK() ((void)0)
+#endif
+
+/* Heap budget (0 = unlimited) and pressure callback */
+#define COMPACT_BATCH 256 /* Blocks per compaction step under pressure */
+
+static size_t budget_soft;
+static size_t budget_hard;
+static mm_pressure_fn pressure_fn;
+static void *pressure_arg;
+
+/*
+ * Handle table. A handle is the address of a slot's ptr field, which
+ * holds the user payload. The first word of a handle block's payload
+ * points back to the slot, and the user payload starts DSIZE after it.
+ */
+#define HANDLE_MAX (1 << 16) /* Handles live at once */
+
+typedef struct hslot
+{
+    void *ptr;          /* User payload, or next free slot */
+    unsigned long pins; /* mm_hlock nesting count */
+} hslot_t;
+
+static hslot_t handles[HANDLE_MAX];
+static hslot_t *hslot_free; /* Free slot list, threaded through ptr */
+static int hslot_used;      /* Slots handed out since mm_init */
+static char *compact_cursor; /* Block where mm_compact resumes (NULL = start) */
+
+#define HANDLE_SLOT(bp) (*(hslot_t **)(bp))
+
+/* Out-of-band block-start and allocation bitmaps */
+#ifndef BITMAP
+#define BITMAP 0 /* Set to 1 to maintain the side bitmaps */
+#endif
+
+#define BM_MAX_HEAP (1 << 26)                 /* Heap bytes covered: 64 MB */
+#define BM_WORDS (BM_MAX_HEAP / DSIZE / 64)  /* 64-bit words per bitmap */
+#define BM_SCAN_WORDS 8                       /* Backward scan before using the footer */
+
+#define BM_IDX(bp) ((size_t)((char *)(bp) - heap_base) / DSIZE)
+#define BM_TEST(map, i) (((map)[(i) / 64] >> ((i) % 64)) & 1)
+#define BM_SET(map, i) ((map)[(i) / 64] |= 1UL << ((i) % 64))
+#define BM_CLR(map, i) ((map)[(i) / 64] &= ~(1UL << ((i) % 64)))
+
+/* Side tables and the free queue are private to one process */
+#if SHARED_HEAP && (BITMAP || BG_MAINT)
+#error "SHARED_HEAP cannot be combined with BITMAP or BG_MAINT"
+#endif
+
+#if BITMAP
+static unsigned long bm_start[BM_WORDS]; /* Bit set at each block's payload granule */
+static unsigned long bm_alloc[BM_WORDS]; /* Bit set if that block is allocated */
+static size_t bm_used;                   /* Words dirtied since the last mm_init */
+#endif
 
 /* Function prototypes for private helper functions */
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
+static void *search_list(int index, size_t asize, unsigned long *probes);
 static int get_list_index(size_t size);
 static void insert_block(void *bp);
 static void remove_block(void *bp);
+#if BITMAP
+static void bitmap_mark(void *bp, int alloc);
+static char *bitmap_prev_block(void *bp);
+#endif
+static void *slide_block(void *bp, void *hbp);
+static void trim_heap(void);
+static void *malloc_block(size_t size);
+static void free_block(void *bp);
+static int compact_steps(int steps);
+static void purge_free_pages(void);
+static void pressure(int level);
+static void *reclaim(size_t asize);
+#if BG_MAINT
+static int drain_queue(void);
+static void *maint_thread(void *arg);
+#endif
+#if SHARED_HEAP
+static int shared_lock_init(pthread_mutex_t *lock);
+static void shared_lock(void);
+#endif
+static int check_heap(void);
+static int free_in_bin(char *bp, int i);
+#if BITMAP
+static int check_bitmap(char *bp, size_t size);
+#endif
 
 /*
  * get_list_index - Determine which list to use based on size
@@ -112,21 +338,37 @@ static int get_list_index(size_t size)
 }
 
 /*
- * insert_block - Insert a block into the explicit free list (LIFO)
+ * insert_block - Insert a block into its explicit free list, keeping the
+ * list size-ascending for best fit and address-ascending otherwise. The
+ * last bin, whose blocks may be of any size above its floor, is always
+ * size-ascending so that its largest block is at hand (see search_list).
  */
 
 static void insert_block(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
     int index = get_list_index(size);
-    char *curr = seg_list[index];
+    char *curr = LIST_HEAD(index);
     char *prev = NULL;
 
-    // Traverse to find the correct position (size-ascending)
-    while (curr != NULL && GET_SIZE(HDRP(curr)) < size)
+    // Traverse to find the correct position
+    if (hp->fit_policy == MM_FIT_BEST || index == N_LISTS - 1)
     {
-        prev = curr;
-        curr = GET_SUCC(curr);
+        while (curr != NULL && GET_SIZE(HDRP(curr)) < size)
+        {
+            PREFETCH_SUCC(curr);
+            prev = curr;
+            curr = GET_SUCC(curr);
+        }
+    }
+    else
+    {
+        while (curr != NULL && curr < (char *)bp)
+        {
+            PREFETCH_SUCC(curr);
+            prev = curr;
+            curr = GET_SUCC(curr);
+        }
     }
 
     SET_SUCC(bp, curr);
@@ -134,11 +376,13 @@ static void insert_block(void *bp)
 
     if (curr != NULL)
         SET_PRED(curr, bp);
+    else if (index == N_LISTS - 1)
+        SET_LAST_TAIL(bp);
 
     if (prev != NULL)
         SET_SUCC(prev, bp);
     else
-        seg_list[index] = bp; // bp becomes head if prev is NULL
+        SET_LIST_HEAD(index, bp); // bp becomes head if prev is NULL
 }
 
 /*
@@ -152,56 +396,117 @@ static void remove_block(void *bp)
     char *pred = GET_PRED(bp);
     char *succ = GET_SUCC(bp);
 
+    if (ROVER(index) == bp)
+        SET_ROVER(index, succ);
+
     if (pred == NULL)
-        seg_list[index] = succ;
+        SET_LIST_HEAD(index, succ);
     else
         SET_SUCC(pred, succ);
 
     if (succ != NULL)
         SET_PRED(succ, pred);
+    else if (index == N_LISTS - 1)
+        SET_LAST_TAIL(pred);
+}
+
+#if BITMAP
+/*
+ * bitmap_mark - Record that a block starts at bp with the given state
+ */
+static void bitmap_mark(void *bp, int alloc)
+{
+    size_t i = BM_IDX(bp);
+
+    BM_SET(bm_start, i);
+    if (alloc)
+        BM_SET(bm_alloc, i);
+    else
+        BM_CLR(bm_alloc, i);
+    if (i / 64 >= bm_used)
+        bm_used = i / 64 + 1;
+}
+
+/*
+ * bitmap_prev_block - Return the payload of the block before bp by scanning
+ * the start bitmap backwards. Falls back to the boundary tag when the
+ * previous block is too large to find within BM_SCAN_WORDS words.
+ */
+static char *bitmap_prev_block(void *bp)
+{
+    size_t i = BM_IDX(bp) - 1;
+    size_t w = i / 64;
+    size_t stop = (w >= BM_SCAN_WORDS) ? w - BM_SCAN_WORDS : 0;
+    unsigned long bits = bm_start[w] & (~0UL >> (63 - i % 64));
+
+    while (bits == 0)
+    {
+        if (w == stop)
+            return PREV_BLKP(bp);
+        bits = bm_start[--w];
+    }
+    return heap_base + (w * 64 + 63 - __builtin_clzl(bits)) * DSIZE;
 }
+#endif
 
 /*
  * coalesce - Boundary tag coalescing. Return ptr to coalesced block
  */
 static void *coalesce(void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
+    char *next_bp = (char *)bp + size;
+#if BITMAP
+    char *prev_bp = bitmap_prev_block(bp);
+    size_t prev_alloc = BM_TEST(bm_alloc, BM_IDX(prev_bp));
+    size_t next_alloc = BM_TEST(bm_alloc, BM_IDX(next_bp));
+#else
+    char *prev_bp = PREV_BLKP(bp);
+    size_t prev_alloc = GET_ALLOC(HDRP(prev_bp));
+    size_t next_alloc = GET_ALLOC(HDRP(next_bp));
+#endif
 
-    int prev_free = !prev_alloc;
-    int next_free = !next_alloc;
+    if (!prev_alloc)
+        remove_block(prev_bp);
+    if (!next_alloc)
+        remove_block(next_bp);
 
+#if BITMAP
+    /* Blocks absorbed into a free neighbour no longer start anywhere */
     if (!prev_alloc)
-        remove_block(PREV_BLKP(bp));
+        BM_CLR(bm_start, BM_IDX(bp));
     if (!next_alloc)
-        remove_block(NEXT_BLKP(bp));
+        BM_CLR(bm_start, BM_IDX(next_bp));
+#endif
 
     if (prev_alloc && next_alloc)
     { /* Case 1: no coalesce */
     }
-    else if (prev_alloc && next_free)
+    else if (prev_alloc && !next_alloc)
     { /* Case 2: next free */
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        size += GET_SIZE(HDRP(next_bp));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
     }
     else if (!prev_alloc && next_alloc)
     { /* Case 3: prev free */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        size += (char *)bp - prev_bp;
         PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+        PUT(HDRP(prev_bp), PACK(size, 0));
+        bp = prev_bp;
     }
     else
     { /* Case 4: both free */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+        size += ((char *)bp - prev_bp) + GET_SIZE(HDRP(next_bp));
+        PUT(HDRP(prev_bp), PACK(size, 0));
+        PUT(FTRP(prev_bp), PACK(size, 0));
+        bp = prev_bp;
     }
 
+    /* mm_compact must not resume from the middle of the merged block */
+    if (compact_cursor > (char *)bp && compact_cursor < (char *)bp + size)
+        compact_cursor = bp;
+
     // Insert **once** after coalesce
     insert_block(bp);
     return bp;
@@ -220,42 +525,315 @@ static void *extend_heap(size_t words)
     if ((long)(bp = mem_sbrk(size)) == -1)
         return NULL;
 
+#if BITMAP
+    /* Give the memory back if the bitmaps cannot describe it */
+    if (BM_IDX(bp + size) >= BM_WORDS * 64)
+    {
+        mem_sbrk(-(int)size);
+        return NULL;
+    }
+#endif
+
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
     PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
+#if BITMAP
+    bitmap_mark(bp, 0);
+    bitmap_mark(NEXT_BLKP(bp), 1);
+#endif
 
     /* Coalesce if the previous block was free (and insert into list) */
     return coalesce(bp);
 }
 
+#if SHARED_HEAP
+/*
+ * shared_lock_init - Make lock a robust mutex usable across processes
+ */
+static int shared_lock_init(pthread_mutex_t *lock)
+{
+    pthread_mutexattr_t attr;
+    int err;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    err = pthread_mutex_init(lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return err;
+}
+
+/*
+ * shared_lock - Take the heap lock. If its owner died holding it, take it
+ * over anyway; the dead process may have left one operation half done.
+ */
+static void shared_lock(void)
+{
+    if (pthread_mutex_lock(&hp->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&hp->lock);
+}
+#endif
+
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
     int i;
+    int err = 0;
+
+#if SHARED_HEAP
+    /* The heap state and its lock go first; nobody else uses the heap yet */
+    if ((hp = mem_sbrk(HEAP_HDR_SIZE)) == (void *)-1)
+        return -1;
+    hp->magic = 0;
+    if (shared_lock_init(&hp->lock) != 0)
+        return -1;
+#endif
+    LOCK();
+#if BG_MAINT
+    /* Blocks still queued belong to the heap being discarded */
+    __atomic_store_n(&free_queue, NULL, __ATOMIC_RELAXED);
+    if (!bg_started)
+    {
+        pthread_t tid;
+
+        if (pthread_create(&tid, NULL, maint_thread, NULL) == 0)
+        {
+            pthread_detach(tid);
+            bg_started = 1;
+        }
+    }
+#endif
     /* Initialize all segregated list heads to NULL */
     for (i = 0; i < N_LISTS; i++)
     {
-        seg_list[i] = NULL;
+        SET_LIST_HEAD(i, NULL);
+        SET_ROVER(i, NULL);
     }
+    SET_LAST_TAIL(NULL);
+    hp->fit_policy = req_policy;
+    hp->fit_max_probes = req_max_probes;
+    hp->root = 0;
+    memset(&fit_stats, 0, sizeof(fit_stats));
+    heap_base = mem_heap_lo();
+    hslot_free = NULL;
+    hslot_used = 0;
+    compact_cursor = NULL;
+
+#if BITMAP
+    memset(bm_start, 0, bm_used * sizeof(unsigned long));
+    memset(bm_alloc, 0, bm_used * sizeof(unsigned long));
+    bm_used = 0;
+#endif
 
     /* Create the initial empty heap (4 * WSIZE = 32 bytes) */
     if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1)
+    {
+        UNLOCK();
         return -1;
+    }
 
     PUT(heap_listp, 0);                            /* Alignment padding (8 bytes) */
     PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, 1)); /* Prologue header */
     PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, 1)); /* Prologue footer */
     PUT(heap_listp + (3 * WSIZE), PACK(0, 1));     /* Epilogue header */
     heap_listp += (2 * WSIZE);                     /* heap_listp points to the payload of the prologue block */
+#if BITMAP
+    bitmap_mark(heap_listp, 1);
+    bitmap_mark(heap_listp + DSIZE, 1);
+#endif
 
     /* Extend the heap with a CHUNKSIZE bytes free block */
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+        err = -1;
+#if SHARED_HEAP
+    else
+        hp->magic = HEAP_MAGIC; /* Other processes may mm_attach now */
+#endif
+
+    UNLOCK();
+    return err;
+}
+
+/*
+ * mm_attach - Use the heap that another process built with mm_init in
+ * the shared memlib region this process has mapped, possibly at another
+ * address. Returns -1 if there is no such heap or SHARED_HEAP is off.
+ */
+int mm_attach(void)
+{
+#if SHARED_HEAP
+    heap_base = mem_heap_lo();
+    if (mem_heapsize() < HEAP_HDR_SIZE + 4 * WSIZE ||
+        ((heap_hdr_t *)heap_base)->magic != HEAP_MAGIC)
         return -1;
 
+    hp = (heap_hdr_t *)heap_base;
+    heap_listp = heap_base + HEAP_HDR_SIZE + 2 * WSIZE;
+    memset(&fit_stats, 0, sizeof(fit_stats));
+    hslot_free = NULL;
+    hslot_used = 0;
+    compact_cursor = NULL;
     return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_recover - Reopen a heap that no other process is using, such as a
+ * file-backed heap after a restart. The lock is rebuilt since its old
+ * state means nothing now, and the heap is only used if mm_check passes.
+ * Returns -1 otherwise; the caller should then start over with mm_init.
+ */
+int mm_recover(void)
+{
+#if SHARED_HEAP
+    if (mm_attach() < 0 || shared_lock_init(&hp->lock) != 0)
+        return -1;
+    return check_heap();
+#else
+    return -1;
+#endif
+}
+
+/*
+ * mm_check - Check the heap for consistency. Returns 0 if it is sound.
+ */
+int mm_check(void)
+{
+    int err;
+
+    LOCK();
+    err = check_heap();
+    UNLOCK();
+    return err;
+}
+
+/*
+ * check_heap - Walk every block and every free list. Blocks must tile
+ * the heap from the prologue to an epilogue at the brk, with matching
+ * boundary tags and no two free blocks in a row. Each free block must
+ * be on exactly the list for its size, with consistent links. The root,
+ * if set, must be one of the allocated blocks. With BITMAP, the bitmaps
+ * must agree with the boundary tags. The caller holds the heap lock.
+ */
+static int check_heap(void)
+{
+    char *lo = heap_base + HEAP_HDR_SIZE;
+    char *end = (char *)mem_heap_hi() + 1;
+    char *root = TO_PTR(hp->root);
+    char *bp, *pred;
+    size_t size, nfree = 0, nlisted = 0;
+    int i, prev_free = 0;
+
+    if (heap_listp != lo + 2 * WSIZE || GET(HDRP(heap_listp)) != PACK(DSIZE, 1) ||
+        GET(FTRP(heap_listp)) != PACK(DSIZE, 1))
+        return -1;
+
+    for (bp = NEXT_BLKP(heap_listp); (size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp))
+    {
+        if (size % DSIZE != 0 || size < 2 * DSIZE || bp + size > end ||
+            GET(HDRP(bp)) != GET(FTRP(bp)))
+            return -1;
+#if BITMAP
+        if (check_bitmap(bp, size) != 0)
+            return -1;
+#endif
+        if (!GET_ALLOC(HDRP(bp)))
+        {
+            if (prev_free || bp == root)
+                return -1;
+            nfree++;
+        }
+        else if (bp == root)
+            root = NULL; // Found it
+        prev_free = !GET_ALLOC(HDRP(bp));
+    }
+    if (bp != end || !GET_ALLOC(HDRP(bp)) || root != NULL)
+        return -1;
+#if BITMAP
+    if (!BM_TEST(bm_start, BM_IDX(heap_listp)) || !BM_TEST(bm_start, BM_IDX(end)) ||
+        !BM_TEST(bm_alloc, BM_IDX(end)))
+        return -1;
+    for (i = BM_IDX(end) + 1; (size_t)i < bm_used * 64; i++)
+        if (BM_TEST(bm_start, i))
+            return -1;
+#endif
+
+    for (i = 0; i < N_LISTS; i++)
+    {
+        pred = NULL;
+        for (bp = LIST_HEAD(i); bp != NULL; pred = bp, bp = GET_SUCC(bp))
+        {
+            /* Bounding the walk also catches cycles */
+            if (++nlisted > nfree || !free_in_bin(bp, i) || GET_PRED(bp) != pred)
+                return -1;
+        }
+        if (i == N_LISTS - 1 && LAST_TAIL() != pred)
+            return -1;
+        if (ROVER(i) != NULL && !free_in_bin(ROVER(i), i))
+            return -1;
+    }
+    return nlisted == nfree ? 0 : -1;
+}
+
+/*
+ * free_in_bin - Is bp, read from a list of a heap being checked, a free
+ * block inside the heap that belongs in bin i?
+ */
+static int free_in_bin(char *bp, int i)
+{
+    char *lo = heap_base + HEAP_HDR_SIZE;
+
+    if (bp < NEXT_BLKP(heap_listp) || bp + 2 * DSIZE > (char *)mem_heap_hi() + 1 ||
+        (size_t)(bp - lo) % DSIZE != 0)
+        return 0;
+    return !GET_ALLOC(HDRP(bp)) && get_list_index(GET_SIZE(HDRP(bp))) == i;
+}
+
+#if BITMAP
+/*
+ * check_bitmap - Does the start bitmap mark bp, and only bp, within the
+ * block, and does the alloc bitmap give its state?
+ */
+static int check_bitmap(char *bp, size_t size)
+{
+    size_t i = BM_IDX(bp), n = size / DSIZE;
+
+    if (!BM_TEST(bm_start, i) || BM_TEST(bm_alloc, i) != GET_ALLOC(HDRP(bp)))
+        return -1;
+    while (--n > 0)
+        if (BM_TEST(bm_start, i + n))
+            return -1;
+    return 0;
+}
+#endif
+
+/*
+ * mm_set_root - Record bp as the block a later process reopening the
+ * heap should start from (NULL to clear it)
+ */
+void mm_set_root(void *bp)
+{
+    LOCK();
+    hp->root = TO_OFF(bp);
+    UNLOCK();
+}
+
+/*
+ * mm_get_root - Return the block recorded by mm_set_root, or NULL
+ */
+void *mm_get_root(void)
+{
+    void *bp;
+
+    LOCK();
+    bp = TO_PTR(hp->root);
+    UNLOCK();
+    return bp;
 }
 
 /*
@@ -277,51 +855,174 @@ static void place(void *bp, size_t asize)
         PUT(HDRP(next_bp), PACK(csize - asize, 0));
         PUT(FTRP(next_bp), PACK(csize - asize, 0));
         insert_block(next_bp);
+#if BITMAP
+        bitmap_mark(next_bp, 0);
+#endif
     }
     else
     {
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
     }
+#if BITMAP
+    BM_SET(bm_alloc, BM_IDX(bp));
+#endif
+}
+/*
+ * search_list - Return the first block in list index that holds asize
+ * bytes, starting at the rover for next fit. Gives up after fit_max_probes
+ * blocks when a bound is set, and find_fit moves on to the next bin, where
+ * any block fits. The last bin has no such fallback, so there the bounded
+ * search goes on from the largest block down, keeping the smallest one
+ * that fits; if even the largest is too small, nothing in the bin fits.
+ * Every block examined is counted in *probes.
+ */
+static void *search_list(int index, size_t asize, unsigned long *probes)
+{
+    char *start = LIST_HEAD(index);
+    char *bp, *fit = NULL;
+    int n = 0;
+
+    if (hp->fit_policy == MM_FIT_NEXT && ROVER(index) != NULL)
+        start = ROVER(index);
+
+    for (bp = start; bp != NULL;)
+    {
+        PREFETCH_SUCC(bp);
+        (*probes)++;
+        if (GET_SIZE(HDRP(bp)) >= asize)
+        {
+            if (hp->fit_policy == MM_FIT_NEXT)
+                SET_ROVER(index, bp); // place() advances it past bp
+            return bp;
+        }
+        if (hp->fit_max_probes > 0 && ++n >= hp->fit_max_probes)
+            break;
+
+        bp = GET_SUCC(bp);
+        if (bp == NULL && start != LIST_HEAD(index))
+            bp = LIST_HEAD(index); // next fit: wrap around to the head
+        if (bp == start)
+            return NULL;
+    }
+    if (bp == NULL || index < N_LISTS - 1)
+        return NULL;
+
+    for (n = 0, bp = LAST_TAIL(); bp != NULL && n < hp->fit_max_probes; n++)
+    {
+        (*probes)++;
+        if (GET_SIZE(HDRP(bp)) < asize)
+            break;
+        fit = bp;
+        bp = GET_PRED(bp);
+    }
+    return fit;
 }
+
 /*
- * find_fit - Find a fit for a block with asize bytes (First-Fit on SegList)
+ * find_fit - Find a fit for a block with asize bytes on the SegList.
+ * Bins are searched from asize's own class upward. With size-ordered bins
+ * the first block that fits is also the best fit, and any block in a
+ * higher bin fits, so the search stops in the first bin with a hit.
  */
 static void *find_fit(size_t asize)
 {
     int index = get_list_index(asize);
+    char *bp = NULL;
+    unsigned long probes = 0;
+
+    for (; index < N_LISTS && bp == NULL; index++)
+        bp = search_list(index, asize, &probes);
+
+    fit_stats.searches++;
+    fit_stats.probes += probes;
+    if (probes > fit_stats.max_probes)
+        fit_stats.max_probes = probes;
+
+    return bp;
+}
+
+/*
+ * mm_set_fit_policy - Select the placement policy and the per-bin probe
+ * bound (0 = unbounded). Takes effect at the next mm_init.
+ */
+void mm_set_fit_policy(int policy, int max_probes)
+{
+    req_policy = policy;
+    req_max_probes = max_probes;
+}
+
+/*
+ * mm_get_fit_stats - Report fit search statistics since the last mm_init
+ */
+void mm_get_fit_stats(mm_fit_stats_t *stats)
+{
+    *stats = fit_stats;
+}
+
+/*
+ * mm_get_free_stats - Count the blocks on the free lists. Blocks still
+ * queued for the maintenance thread are not counted.
+ */
+void mm_get_free_stats(mm_free_stats_t *stats)
+{
+    unsigned long n;
     char *bp;
-    char *best_bp = NULL;
-    size_t min_diff = (size_t)-1;
+    int i;
 
-    // Search each list starting from index
-    for (; index < N_LISTS; index++)
+    memset(stats, 0, sizeof(*stats));
+    LOCK();
+    for (i = 0; i < N_LISTS; i++)
     {
-        for (bp = seg_list[index]; bp != NULL; bp = GET_SUCC(bp))
-        {
-            size_t bsize = GET_SIZE(HDRP(bp));
-            if (bsize >= asize)
-            {
-                size_t diff = bsize - asize;
-                if (diff < min_diff)
-                {
-                    best_bp = bp;
-                    min_diff = diff;
-                    if (diff == 0)
-                        return best_bp; // perfect fit
-                }
-            }
-        }
-        if (best_bp != NULL)
-            return best_bp;
+        for (n = 0, bp = LIST_HEAD(i); bp != NULL; bp = GET_SUCC(bp), n++)
+            stats->bytes += GET_SIZE(HDRP(bp));
+        stats->blocks += n;
+        if (n > stats->max_list)
+            stats->max_list = n;
     }
+    UNLOCK();
+}
+
+/*
+ * mm_walk_heap - Call fn on every block of the heap, in address order.
+ * Blocks still queued for the maintenance thread show as allocated.
+ */
+void mm_walk_heap(mm_walk_fn fn, void *arg)
+{
+    mm_block_t blk;
+    char *bp;
 
-    return NULL; // no fit
+    LOCK();
+    for (bp = NEXT_BLKP(heap_listp); (blk.size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp))
+    {
+        blk.bp = bp;
+        blk.alloc = GET_ALLOC(HDRP(bp));
+        blk.bin = blk.alloc ? -1 : get_list_index(blk.size);
+        /* A movable block's payload starts after its handle slot */
+        blk.overhead = DSIZE + (blk.alloc && GET_MOVABLE(HDRP(bp)) ? DSIZE : 0);
+        fn(&blk, arg);
+    }
+    UNLOCK();
 }
+
 /*
- * mm_malloc - Allocate a block by searching the free list.
+ * mm_block_size - The size of the block mm_malloc needs for a request of
+ * size bytes, before any split remainder too small to free
  */
-void *mm_malloc(size_t size)
+size_t mm_block_size(size_t size)
+{
+    // Minimum block size for explicit list is 2*DSIZE (32 bytes)
+    if (size <= DSIZE)
+        return 2 * DSIZE;
+    // asize = ALIGN(payload size + overhead size)
+    return ALIGN(size + DSIZE);
+}
+
+/*
+ * malloc_block - Allocate a block by searching the free list. The caller
+ * holds the heap lock.
+ */
+static void *malloc_block(size_t size)
 {
     size_t asize;      /* Adjusted block size */
     size_t extendsize; /* Amount to extend heap if no fit */
@@ -331,12 +1032,7 @@ void *mm_malloc(size_t size)
         return NULL;
 
     /* Adjust block size to include overhead and alignment reqs. */
-    // Minimum block size for explicit list is 2*DSIZE (32 bytes)
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        // asize = ALIGN(payload size + overhead size)
-        asize = ALIGN(size + DSIZE);
+    asize = mm_block_size(size);
 
     /* Search the free list for a fit */
     if ((bp = find_fit(asize)) != NULL)
@@ -345,9 +1041,47 @@ void *mm_malloc(size_t size)
         return bp;
     }
 
+#if BG_MAINT
+    /* Blocks still waiting for the maintenance thread may make room */
+    if (drain_queue() > 0 && (bp = find_fit(asize)) != NULL)
+    {
+        place(bp, asize);
+        return bp;
+    }
+#endif
+
     /* No fit found. Extend heap and place the block */
     // extendsize = ((asize + CHUNKSIZE - 1) / CHUNKSIZE) * CHUNKSIZE;
     extendsize = MAX(asize, CHUNKSIZE);
+    if (budget_hard && mem_heapsize() + extendsize > budget_hard)
+    {
+        if ((bp = reclaim(asize)) != NULL)
+        {
+            place(bp, asize);
+            return bp;
+        }
+        /* reclaim trimmed any free block off the top, so asize is all
+           the heap has to grow by */
+        if (mem_heapsize() + extendsize > budget_hard)
+            extendsize = asize; // skip the slack of a full chunk
+        if (mem_heapsize() + extendsize > budget_hard)
+            return NULL;
+    }
+    if (budget_soft && mem_heapsize() <= budget_soft &&
+        mem_heapsize() + extendsize > budget_soft)
+    {
+        pressure(MM_PRESSURE_SOFT);
+#if BG_MAINT
+        drain_queue();
+#endif
+        /* What the callback freed may be enough */
+        if ((bp = find_fit(asize)) != NULL)
+        {
+            place(bp, asize);
+            return bp;
+        }
+        purge_free_pages();
+    }
     if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
         return NULL;
     place(bp, asize);
@@ -355,20 +1089,158 @@ void *mm_malloc(size_t size)
 }
 
 /*
- * mm_free - Freeing a block and coalescing it.
+ * free_block - Freeing a block and coalescing it. The caller holds the
+ * heap lock.
  */
-void mm_free(void *bp)
+static void free_block(void *bp)
 {
     size_t size = GET_SIZE(HDRP(bp));
 
     // Mark block as free
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
+#if BITMAP
+    BM_CLR(bm_alloc, BM_IDX(bp));
+#endif
 
     // Coalesce with neighbors and insert the new free block into the free list
     coalesce(bp);
 }
 
+/*
+ * mm_malloc - Allocate a block by searching the free list.
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp;
+
+    LOCK();
+    bp = malloc_block(size);
+    UNLOCK();
+    return bp;
+}
+
+/*
+ * mm_free - Freeing a block and coalescing it. With BG_MAINT the block
+ * is only queued for the maintenance thread.
+ */
+void mm_free(void *bp)
+{
+#if BG_MAINT
+    void *head = __atomic_load_n(&free_queue, __ATOMIC_RELAXED);
+
+    do
+        *(void **)bp = head;
+    while (!__atomic_compare_exchange_n(&free_queue, &head, bp, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+    LOCK();
+    free_block(bp);
+    UNLOCK();
+#endif
+}
+
+/*
+ * purge_free_pages - Return the whole pages inside large free blocks to
+ * the OS. The list links and boundary tags stay resident.
+ */
+static void purge_free_pages(void)
+{
+    size_t pagesize = mem_pagesize();
+    char *bp, *lo, *hi;
+
+    for (bp = LIST_HEAD(N_LISTS - 1); bp != NULL; bp = GET_SUCC(bp))
+    {
+        lo = (char *)(((size_t)bp + DSIZE + pagesize - 1) & ~(pagesize - 1));
+        hi = (char *)((size_t)FTRP(bp) & ~(pagesize - 1));
+        if (hi > lo)
+            madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+}
+
+/*
+ * pressure - Run the pressure callback for level without the heap lock,
+ * so that it may free memory
+ */
+static void pressure(int level)
+{
+    if (pressure_fn == NULL)
+        return;
+    UNLOCK();
+    pressure_fn(level, mem_heapsize(), pressure_arg);
+    LOCK();
+}
+
+/*
+ * reclaim - Growing the heap would break the hard budget. Let the
+ * application drop memory, then compact and trim, and retry the fit.
+ */
+static void *reclaim(size_t asize)
+{
+    char *bp;
+
+    pressure(MM_PRESSURE_HARD);
+#if BG_MAINT
+    drain_queue();
+#endif
+    if ((bp = find_fit(asize)) != NULL)
+        return bp;
+
+    while (compact_steps(COMPACT_BATCH))
+        ;
+    return find_fit(asize);
+}
+
+#if BG_MAINT
+/*
+ * drain_queue - Free every queued block and return how many there were.
+ * The caller holds the heap lock.
+ */
+static int drain_queue(void)
+{
+    void *bp = __atomic_exchange_n(&free_queue, NULL, __ATOMIC_ACQUIRE);
+    void *next;
+    int n = 0;
+
+    for (; bp != NULL; bp = next, n++)
+    {
+        next = *(void **)bp;
+        free_block(bp);
+    }
+    return n;
+}
+
+/*
+ * maint_thread - Drain the free queue while frees keep arriving, and
+ * purge free pages once after each busy period
+ */
+static void *maint_thread(void *arg)
+{
+    struct timespec period = {0, BG_PERIOD_NS};
+    int dirty = 0;
+
+    for (;;)
+    {
+        nanosleep(&period, NULL);
+        if (__atomic_load_n(&free_queue, __ATOMIC_RELAXED) != NULL)
+        {
+            LOCK();
+            drain_queue();
+            UNLOCK();
+            dirty = 1;
+        }
+        else if (dirty)
+        {
+            LOCK();
+            purge_free_pages();
+            UNLOCK();
+            dirty = 0;
+        }
+    }
+    return NULL;
+}
+#endif
+
 /*
  * mm_realloc - Simple realloc implementation using mm_malloc and mm_free.
  */
@@ -404,3 +1276,340 @@ void *mm_realloc(void *ptr, size_t size)
 
     return newptr;
 }
+
+/*
+ * slide_block - Move the handle block hbp down into the free block bp that
+ * precedes it, and return the free block that ends up above it.
+ */
+static void *slide_block(void *bp, void *hbp)
+{
+    size_t fsize = GET_SIZE(HDRP(bp));
+    size_t hsize = GET_SIZE(HDRP(hbp));
+    char *free_bp = (char *)bp + hsize;
+
+    remove_block(bp);
+#if BITMAP
+    BM_CLR(bm_start, BM_IDX(hbp));
+    BM_CLR(bm_alloc, BM_IDX(hbp));
+    bitmap_mark(bp, 1);
+    bitmap_mark(free_bp, 0);
+#endif
+
+    /* Header, payload and footer move together */
+    memmove(HDRP(bp), HDRP(hbp), hsize);
+    HANDLE_SLOT(bp)->ptr = (char *)bp + DSIZE;
+
+    PUT(HDRP(free_bp), PACK(fsize, 0));
+    PUT(FTRP(free_bp), PACK(fsize, 0));
+    return coalesce(free_bp);
+}
+
+/*
+ * trim_heap - Give a free block at the top of the heap back to memlib
+ */
+static void trim_heap(void)
+{
+    char *bp = PREV_BLKP((char *)mem_heap_hi() + 1); /* Last block */
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (GET_ALLOC(HDRP(bp)))
+        return;
+
+    remove_block(bp);
+    if (mem_sbrk(-(int)size) == (void *)-1)
+    {
+        insert_block(bp);
+        return;
+    }
+    PUT(HDRP(bp), PACK(0, 1)); /* New epilogue header */
+#if BITMAP
+    BM_CLR(bm_start, BM_IDX(bp + size));
+    bitmap_mark(bp, 1);
+#endif
+}
+
+/*
+ * mm_halloc - Allocate a relocatable block and return its handle
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    hslot_t *slot;
+    char *bp;
+
+    /* Handle slots are process-private, so a shared heap has no handles */
+    if (size == 0 || SHARED_HEAP)
+        return NULL;
+
+    LOCK();
+    if ((hslot_free == NULL && hslot_used == HANDLE_MAX) ||
+        (bp = malloc_block(size + DSIZE)) == NULL)
+    {
+        UNLOCK();
+        return NULL;
+    }
+
+    /* Only now take a slot: the pressure callback run by malloc_block may
+       have freed handles or allocated some of its own */
+    if (hslot_free != NULL)
+    {
+        slot = hslot_free;
+        hslot_free = slot->ptr;
+    }
+    else if (hslot_used < HANDLE_MAX)
+        slot = &handles[hslot_used++];
+    else
+    {
+        free_block(bp);
+        UNLOCK();
+        return NULL;
+    }
+
+    /* Both tags carry the bit, so they still match for mm_check */
+    PUT(HDRP(bp), GET(HDRP(bp)) | 0x2);
+    PUT(FTRP(bp), GET(FTRP(bp)) | 0x2);
+    HANDLE_SLOT(bp) = slot;
+    slot->ptr = bp + DSIZE;
+    slot->pins = 0;
+    UNLOCK();
+    return &slot->ptr;
+}
+
+/*
+ * mm_hfree - Free a block allocated by mm_halloc and retire its handle
+ */
+void mm_hfree(mm_handle_t h)
+{
+    hslot_t *slot = (hslot_t *)h;
+
+    LOCK();
+    free_block((char *)slot->ptr - DSIZE);
+    slot->ptr = hslot_free;
+    hslot_free = slot;
+    UNLOCK();
+}
+
+/*
+ * mm_hlock - Pin a handle's block in place and return its payload. The
+ * pointer stays valid until the matching mm_hunlock.
+ */
+void *mm_hlock(mm_handle_t h)
+{
+    hslot_t *slot = (hslot_t *)h;
+    void *ptr;
+
+    LOCK();
+    slot->pins++;
+    ptr = slot->ptr;
+    UNLOCK();
+    return ptr;
+}
+
+/*
+ * mm_hunlock - Release one mm_hlock pin
+ */
+void mm_hunlock(mm_handle_t h)
+{
+    hslot_t *slot = (hslot_t *)h;
+
+    LOCK();
+    slot->pins--;
+    UNLOCK();
+}
+
+/*
+ * compact_steps - Slide unpinned handle blocks down into the free blocks
+ * below them, visiting or moving at most steps blocks. Returns 1 if there
+ * is more to do, or 0 once the pass has reached the epilogue and the free
+ * top of the heap has been trimmed. The caller holds the heap lock.
+ */
+static int compact_steps(int steps)
+{
+    char *bp = compact_cursor ? compact_cursor : NEXT_BLKP(heap_listp);
+    char *next;
+
+    while (GET_SIZE(HDRP(bp)) > 0)
+    {
+        if (steps-- <= 0)
+        {
+            compact_cursor = bp;
+            return 1;
+        }
+
+        next = NEXT_BLKP(bp);
+        if (!GET_ALLOC(HDRP(bp)) && GET_MOVABLE(HDRP(next)) &&
+            HANDLE_SLOT(next)->pins == 0)
+            bp = slide_block(bp, next);
+        else
+            bp = next;
+    }
+
+    compact_cursor = NULL;
+    trim_heap();
+    return 0;
+}
+
+/*
+ * mm_compact - Run one bounded compaction step (see compact_steps)
+ */
+int mm_compact(int steps)
+{
+    int more;
+
+    LOCK();
+#if BG_MAINT
+    drain_queue(); /* Queued blocks would pin their neighbours in place */
+#endif
+    more = compact_steps(steps);
+    UNLOCK();
+    return more;
+}
+
+/*
+ * mm_set_budget - Set the soft and hard heap size watermarks in bytes
+ * (0 disables either one)
+ */
+void mm_set_budget(size_t soft, size_t hard)
+{
+    LOCK();
+    budget_soft = soft;
+    budget_hard = hard;
+    UNLOCK();
+}
+
+/*
+ * mm_set_pressure_callback - Register fn to run when the heap grows past
+ * a watermark. fn may free memory but must not allocate.
+ */
+void mm_set_pressure_callback(mm_pressure_fn fn, void *arg)
+{
+    LOCK();
+    pressure_fn = fn;
+    pressure_arg = arg;
+    UNLOCK();
+}
+
+/* One piece of mm.c's own state in a checkpoint */
+typedef struct
+{
+    void *p;
+    size_t len;
+} state_piece_t;
+
+#define STATE_MAX_PIECES 16
+
+/*
+ * state_pieces - Fill pc with the statics that make up the allocator
+ * state and return how many there are. The counters come first, because
+ * they give the lengths of the tables that follow.
+ */
+static int state_pieces(state_piece_t *pc)
+{
+    int n = 0;
+
+#define PIECE(ptr, size) (pc[n].p = (ptr), pc[n].len = (size), n++)
+    PIECE(&hslot_used, sizeof(hslot_used));
+#if BITMAP
+    PIECE(&bm_used, sizeof(bm_used));
+#endif
+    PIECE(&hp, sizeof(hp));
+    PIECE(&heap_local, sizeof(heap_local));
+    PIECE(&heap_listp, sizeof(heap_listp));
+    PIECE(&heap_base, sizeof(heap_base));
+    PIECE(&fit_stats, sizeof(fit_stats));
+    PIECE(&hslot_free, sizeof(hslot_free));
+    PIECE(&compact_cursor, sizeof(compact_cursor));
+    PIECE(handles, hslot_used * sizeof(hslot_t));
+#if BITMAP
+    PIECE(bm_start, bm_used * sizeof(unsigned long));
+    PIECE(bm_alloc, bm_used * sizeof(unsigned long));
+#endif
+#undef PIECE
+    return n;
+}
+
+/*
+ * mm_state_size - Bytes needed by mm_save_state for the current heap.
+ * Returns 0 with SHARED_HEAP, whose lock lives in the heap and whose
+ * other users could not follow a rollback.
+ */
+size_t mm_state_size(void)
+{
+    state_piece_t pc[STATE_MAX_PIECES];
+    size_t len;
+    int i, n;
+
+    if (SHARED_HEAP)
+        return 0;
+    LOCK();
+#if BG_MAINT
+    drain_queue();
+#endif
+    len = mem_state_size();
+    n = state_pieces(pc);
+    for (i = 0; i < n; i++)
+        len += pc[i].len;
+    UNLOCK();
+    return len;
+}
+
+/*
+ * mm_save_state - Copy the memlib heap and the allocator state to buf,
+ * which must hold mm_state_size() bytes
+ */
+void mm_save_state(void *buf)
+{
+    state_piece_t pc[STATE_MAX_PIECES];
+    char *p = buf;
+    int i, n;
+
+    if (SHARED_HEAP)
+        return;
+    LOCK();
+#if BG_MAINT
+    drain_queue(); /* Queued blocks would otherwise be lost on load */
+#endif
+    mem_save_state(p);
+    p += mem_state_size();
+    n = state_pieces(pc);
+    for (i = 0; i < n; i++)
+    {
+        memcpy(p, pc[i].p, pc[i].len);
+        p += pc[i].len;
+    }
+    UNLOCK();
+}
+
+/*
+ * mm_load_state - Go back to the heap saved in buf by mm_save_state.
+ * Blocks the caller allocated since then must be forgotten.
+ */
+void mm_load_state(const void *buf)
+{
+    state_piece_t pc[STATE_MAX_PIECES];
+    const char *p = buf;
+    int i, n;
+
+    if (SHARED_HEAP)
+        return;
+    LOCK();
+#if BG_MAINT
+    __atomic_store_n(&free_queue, NULL, __ATOMIC_RELAXED);
+#endif
+#if BITMAP
+    /* Bits past the saved bm_used must read as clear, as after mm_init */
+    memset(bm_start, 0, bm_used * sizeof(unsigned long));
+    memset(bm_alloc, 0, bm_used * sizeof(unsigned long));
+#endif
+    mem_load_state(p);
+    p += mem_state_size();
+
+    /* Each counter loaded may change the length of a later piece */
+    n = state_pieces(pc);
+    for (i = 0; i < n; i++)
+    {
+        n = state_pieces(pc);
+        memcpy(pc[i].p, p, pc[i].len);
+        p += pc[i].len;
+    }
+    UNLOCK();
+}
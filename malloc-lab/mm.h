@@ -4,6 +4,88 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_attach(void);
+extern int mm_recover(void);
+extern int mm_check(void);
+extern void mm_set_root(void *bp);
+extern void *mm_get_root(void);
+
+/* Placement policies for mm_set_fit_policy */
+#define MM_FIT_BEST  0  /* best fit over size-ordered bins */
+#define MM_FIT_FIRST 1  /* first fit over address-ordered bins */
+#define MM_FIT_NEXT  2  /* next fit with a rover per bin */
+
+/* Fit search telemetry, reset by mm_init */
+typedef struct {
+    unsigned long searches;    /* number of find_fit calls */
+    unsigned long probes;      /* free blocks examined in total */
+    unsigned long max_probes;  /* longest single search */
+} mm_fit_stats_t;
+
+/*
+ * Relocatable allocation. A handle stays valid until mm_hfree; the
+ * payload it refers to may move in mm_compact unless it is locked.
+ * Handles are private to a process, so in a SHARED_HEAP build mm_halloc
+ * always returns NULL.
+ */
+typedef void **mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void mm_hfree(mm_handle_t h);
+extern void *mm_hlock(mm_handle_t h);
+extern void mm_hunlock(mm_handle_t h);
+extern int mm_compact(int steps);
+
+/*
+ * Heap budget. The callback runs when the heap grows past the soft
+ * watermark, and before mm.c gives up at the hard one.
+ */
+#define MM_PRESSURE_SOFT 1
+#define MM_PRESSURE_HARD 2
+
+typedef void (*mm_pressure_fn)(int level, size_t heapsize, void *arg);
+
+extern void mm_set_budget(size_t soft, size_t hard);
+extern void mm_set_pressure_callback(mm_pressure_fn fn, void *arg);
+
+/*
+ * Checkpoints. The state covers the memlib heap and mm.c's own tables,
+ * and can only be loaded back into the process that saved it.
+ */
+extern size_t mm_state_size(void);
+extern void mm_save_state(void *buf);
+extern void mm_load_state(const void *buf);
+
+extern void mm_set_fit_policy(int policy, int max_probes);
+extern void mm_get_fit_stats(mm_fit_stats_t *stats);
+
+/* Free list occupancy at one point in time */
+typedef struct {
+    unsigned long blocks;      /* free blocks on all lists */
+    size_t bytes;              /* their total size */
+    unsigned long max_list;    /* blocks on the longest list */
+} mm_free_stats_t;
+
+extern void mm_get_free_stats(mm_free_stats_t *stats);
+
+/*
+ * Heap walking. mm_walk_heap calls fn on every block between the
+ * prologue and the epilogue, in address order.
+ */
+#define MM_NBINS 10 /* Free lists, numbered 0 to MM_NBINS-1 */
+
+typedef struct {
+    void *bp;                  /* payload address */
+    size_t size;               /* block size */
+    size_t overhead;           /* bytes of the block outside its payload */
+    int alloc;                 /* 1 if allocated */
+    int bin;                   /* free list of a free block, else -1 */
+} mm_block_t;
+
+typedef void (*mm_walk_fn)(const mm_block_t *blk, void *arg);
+
+extern void mm_walk_heap(mm_walk_fn fn, void *arg);
+extern size_t mm_block_size(size_t size);
 
 
 /* 
@@ -0,0 +1,176 @@
+/*
+ * mmbench.c - Time mm.c on traces compiled to C by trace2c
+ *
+ * For each compiled trace, mmbench times two replays with fsecs, as
+ * mdriver times its speed runs (mem_reset_brk and mm_init included):
+ *
+ *   compiled     the straight-line replay, which costs little beyond
+ *                the calls into mm.c
+ *   interpreted  the same loop as mdriver's eval_mm_ops, a switch on
+ *                each op with the block pointers looked up in an array
+ *
+ * The difference is the driver's own cost per op, which mdriver's
+ * throughput charges to mm.c. It can come out negative: a compiled trace
+ * is a few hundred KB of code that runs through the instruction cache
+ * once, where the interpreter's loop stays in it and streams a compact
+ * table of ops. On the default traces the two are about even.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "replay.h"
+
+int verbose = 0; /* read by fsecs */
+
+/* Pointers of the interpreted replay, as trace->blocks in mdriver */
+static char **blocks;
+
+static void run_compiled(void *ptr);
+static void run_interpreted(void *ptr);
+static void usage(void);
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/*
+ * run_compiled - One timed run of a compiled replay
+ */
+static void run_compiled(void *ptr)
+{
+	const replay_t *r = ptr;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in run_compiled");
+	r->run();
+}
+
+/*
+ * run_interpreted - One timed run of a replay's ops, interpreted the
+ * way mdriver's eval_mm_ops does
+ */
+static void run_interpreted(void *ptr)
+{
+	const replay_t *r = ptr;
+	int i, index, size, newsize;
+	char *p, *newp, *oldp, *block;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed in run_interpreted");
+	for (i = 0; i < r->num_ops; i++)
+		switch (r->ops[i].type)
+		{
+		case ALLOC:
+			index = r->ops[i].index;
+			size = r->ops[i].size;
+			if ((p = mm_malloc(size)) == NULL)
+				app_error("mm_malloc error in run_interpreted");
+			blocks[index] = p;
+			break;
+
+		case REALLOC:
+			index = r->ops[i].index;
+			newsize = r->ops[i].size;
+			oldp = blocks[index];
+			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+				app_error("mm_realloc error in run_interpreted");
+			blocks[index] = newp;
+			break;
+
+		case FREE:
+			index = r->ops[i].index;
+			block = blocks[index];
+			mm_free(block);
+			break;
+
+		default:
+			app_error("Nonexistent request type in run_interpreted");
+		}
+}
+
+int main(int argc, char **argv)
+{
+	const replay_t *r;
+	double csecs, isecs, ctotal = 0, itotal = 0, ops = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "vh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	init_fsecs();
+	mem_init();
+
+	printf("%-26s %7s %12s %12s %10s %6s\n", "trace", "ops",
+		   "compiled", "interpreted", "driver", "share");
+	printf("%-26s %7s %12s %12s %10s %6s\n", "", "",
+		   "Kops/s", "Kops/s", "ns/op", "");
+	for (r = replays; r->name != NULL; r++)
+	{
+		if ((blocks = calloc(r->num_ids, sizeof(char *))) == NULL)
+			unix_error("calloc failed in main");
+		csecs = fsecs(run_compiled, (void *)r);
+		isecs = fsecs(run_interpreted, (void *)r);
+		free(blocks);
+
+		printf("%-26s %7d %12.0f %12.0f %10.2f %5.1f%%\n", r->name, r->num_ops,
+			   r->num_ops / csecs / 1e3, r->num_ops / isecs / 1e3,
+			   (isecs - csecs) / r->num_ops * 1e9,
+			   100.0 * (isecs - csecs) / isecs);
+		ctotal += csecs;
+		itotal += isecs;
+		ops += r->num_ops;
+	}
+	printf("%-26s %7.0f %12.0f %12.0f %10.2f %5.1f%%\n", "Total", ops,
+		   ops / ctotal / 1e3, ops / itotal / 1e3,
+		   (itotal - ctotal) / ops * 1e9, 100.0 * (itotal - ctotal) / itotal);
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mmbench [-hv]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-v         Report the timing method.\n");
+	fprintf(stderr, "The traces are those compiled in by trace2c (see Makefile).\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	printf("%s\n", msg);
+	exit(1);
+}
@@ -0,0 +1,680 @@
+/*
+ * mmsim.c - Metadata-only simulator of the mm.c allocator
+ *
+ * Replays traces against a model of mm.c's block layout: one record per
+ * block (offset, size, free bit), linked in address order and on the
+ * same segregated free lists, with the same size classes, placement
+ * policies, splitting and coalescing rules. No payload memory exists, so
+ * utilization and fragmentation of a policy can be measured on traces
+ * far too large for the 20 MB simulated heap of mdriver.
+ *
+ * With -B the simulated heap is set against the offline bounds of
+ * bound.c, which bracket the least heap any non-moving allocator needs.
+ *
+ * With -c every trace is also run through the real mm.c, and the peak
+ * heap, utilization, fit search counts and final free lists of the two
+ * runs must agree. Any change to mm.c's layout decisions has to be
+ * mirrored here, and -c is how to tell when it has not been.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+extern char *optarg;
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+#include "bound.h"
+#include "ftimer.h"
+#include "config.h"
+
+/* mm.c's layout constants */
+#define WSIZE 8
+#define DSIZE 16
+#define CHUNKSIZE (1 << 12)
+#define MIN_BLOCK (2 * DSIZE)
+#define N_LISTS 10
+#define ALIGN(size) (((size) + (DSIZE - 1)) & ~(size_t)(DSIZE - 1))
+
+#define MAXLINE 1024
+
+/* One block of the simulated heap */
+typedef struct
+{
+	size_t off;		  /* heap offset of the payload */
+	size_t size;	  /* block size, boundary tags included */
+	int free;		  /* on a free list? */
+	int aprev, anext; /* address neighbours (-1 = prologue / epilogue) */
+	int lprev, lnext; /* free list neighbours (-1 = none) */
+} sblock_t;
+
+/* Results of one run, simulated or real */
+typedef struct
+{
+	double util;	   /* peak payload / peak heap, as in mdriver */
+	size_t peak_heap;  /* highest brk */
+	mm_fit_stats_t fit; /* find_fit search lengths */
+	mm_free_stats_t fs; /* free lists after the last op */
+} simstats_t;
+
+/* Simulated heap */
+static sblock_t *blk;	   /* block records, indexed by block id */
+static int nblk, maxblk;   /* records in use / allocated */
+static int free_ids = -1;  /* recycled records, linked through lnext */
+static int last = -1;	   /* highest block in the heap */
+static size_t heap_brk;	   /* heap size */
+static int list_head[N_LISTS];
+static int rover[N_LISTS];
+static int last_tail;	   /* largest block of the last bin */
+static int policy = MM_FIT_BEST;
+static int max_probes;	   /* per-bin probe bound (0 = unbounded) */
+static mm_fit_stats_t fit; /* as kept by mm.c */
+
+int verbose = 0; /* read by read_trace */
+
+/* Directory where default tracefiles are found */
+static char tracedir[MAXLINE] = TRACEDIR;
+
+/* The filenames of the default tracefiles */
+static char *default_tracefiles[] = {
+	DEFAULT_TRACEFILES, NULL};
+
+static int new_block(size_t off, size_t size);
+static void release_block(int b);
+static int get_list_index(size_t size);
+static void insert_block(int b);
+static void remove_block(int b);
+static int coalesce(int b);
+static int extend_heap(size_t size);
+static void place(int b, size_t asize);
+static int search_list(int index, size_t asize, unsigned long *probes);
+static int find_fit(size_t asize);
+static void sim_init(void);
+static int sim_malloc(size_t size);
+static void sim_free(int b);
+static void sim_free_stats(mm_free_stats_t *stats);
+static void sim_trace(trace_t *trace, simstats_t *st);
+static int real_trace(trace_t *trace, simstats_t *st);
+static int same_stats(simstats_t *a, simstats_t *b);
+static void usage(void);
+static void unix_error(char *msg);
+
+/*
+ * new_block - Get a record for the block [off, off+size)
+ */
+static int new_block(size_t off, size_t size)
+{
+	int b;
+
+	if (free_ids >= 0)
+	{
+		b = free_ids;
+		free_ids = blk[b].lnext;
+	}
+	else
+	{
+		if (nblk == maxblk)
+		{
+			maxblk = maxblk ? 2 * maxblk : 1024;
+			if ((blk = realloc(blk, maxblk * sizeof(sblock_t))) == NULL)
+				unix_error("realloc failed in new_block");
+		}
+		b = nblk++;
+	}
+	blk[b].off = off;
+	blk[b].size = size;
+	blk[b].free = 0;
+	blk[b].aprev = blk[b].anext = -1;
+	blk[b].lprev = blk[b].lnext = -1;
+	return b;
+}
+
+/*
+ * release_block - Recycle the record of a block absorbed by a neighbour
+ */
+static void release_block(int b)
+{
+	blk[b].lnext = free_ids;
+	free_ids = b;
+}
+
+/*
+ * get_list_index - Same size classes as mm.c
+ */
+static int get_list_index(size_t size)
+{
+	int i;
+	size_t limit = 16;
+
+	for (i = 0; i < N_LISTS - 1; i++, limit <<= 1)
+		if (size <= limit)
+			return i;
+	return N_LISTS - 1;
+}
+
+/*
+ * insert_block - Size-ascending for best fit and in the last bin,
+ * address-ascending otherwise
+ */
+static void insert_block(int b)
+{
+	int index = get_list_index(blk[b].size);
+	int curr = list_head[index];
+	int prev = -1;
+
+	if (policy == MM_FIT_BEST || index == N_LISTS - 1)
+		while (curr >= 0 && blk[curr].size < blk[b].size)
+			prev = curr, curr = blk[curr].lnext;
+	else
+		while (curr >= 0 && blk[curr].off < blk[b].off)
+			prev = curr, curr = blk[curr].lnext;
+
+	blk[b].free = 1;
+	blk[b].lnext = curr;
+	blk[b].lprev = prev;
+	if (curr >= 0)
+		blk[curr].lprev = b;
+	else if (index == N_LISTS - 1)
+		last_tail = b;
+	if (prev >= 0)
+		blk[prev].lnext = b;
+	else
+		list_head[index] = b;
+}
+
+/*
+ * remove_block - Unlink b from its free list, advancing the rover past it
+ */
+static void remove_block(int b)
+{
+	int index = get_list_index(blk[b].size);
+
+	if (rover[index] == b)
+		rover[index] = blk[b].lnext;
+	if (blk[b].lprev < 0)
+		list_head[index] = blk[b].lnext;
+	else
+		blk[blk[b].lprev].lnext = blk[b].lnext;
+	if (blk[b].lnext >= 0)
+		blk[blk[b].lnext].lprev = blk[b].lprev;
+	else if (index == N_LISTS - 1)
+		last_tail = blk[b].lprev;
+	blk[b].free = 0;
+}
+
+/*
+ * coalesce - Merge the free block b with free neighbours and insert it
+ */
+static int coalesce(int b)
+{
+	int prev = blk[b].aprev;
+	int next = blk[b].anext;
+	int prev_free = prev >= 0 && blk[prev].free;
+	int next_free = next >= 0 && blk[next].free;
+
+	if (prev_free)
+		remove_block(prev);
+	if (next_free)
+		remove_block(next);
+
+	if (next_free)
+	{
+		blk[b].size += blk[next].size;
+		blk[b].anext = blk[next].anext;
+		if (blk[b].anext >= 0)
+			blk[blk[b].anext].aprev = b;
+		if (last == next)
+			last = b;
+		release_block(next);
+	}
+	if (prev_free)
+	{
+		blk[prev].size += blk[b].size;
+		blk[prev].anext = blk[b].anext;
+		if (blk[prev].anext >= 0)
+			blk[blk[prev].anext].aprev = prev;
+		if (last == b)
+			last = prev;
+		release_block(b);
+		b = prev;
+	}
+	insert_block(b);
+	return b;
+}
+
+/*
+ * extend_heap - Add a free block of size bytes at the top of the heap
+ */
+static int extend_heap(size_t size)
+{
+	int b = new_block(heap_brk, size);
+
+	heap_brk += size;
+	blk[b].aprev = last;
+	if (last >= 0)
+		blk[last].anext = b;
+	last = b;
+	return coalesce(b);
+}
+
+/*
+ * place - Allocate asize bytes at the start of free block b, splitting
+ * off the rest if it makes a block of at least MIN_BLOCK bytes
+ */
+static void place(int b, size_t asize)
+{
+	size_t csize = blk[b].size;
+	int r;
+
+	remove_block(b);
+	if (csize - asize >= MIN_BLOCK)
+	{
+		blk[b].size = asize;
+		r = new_block(blk[b].off + asize, csize - asize);
+		blk[r].aprev = b;
+		blk[r].anext = blk[b].anext;
+		if (blk[r].anext >= 0)
+			blk[blk[r].anext].aprev = r;
+		blk[b].anext = r;
+		if (last == b)
+			last = r;
+		insert_block(r);
+	}
+}
+
+/*
+ * search_list - The first block in list index holding asize bytes,
+ * starting at the rover for next fit and wrapping around. As in mm.c,
+ * max_probes caps the blocks examined, after which the last bin is
+ * searched from its largest block down for the smallest that fits.
+ */
+static int search_list(int index, size_t asize, unsigned long *probes)
+{
+	int start = list_head[index];
+	int b, fit = -1, n = 0;
+
+	if (policy == MM_FIT_NEXT && rover[index] >= 0)
+		start = rover[index];
+
+	for (b = start; b >= 0;)
+	{
+		(*probes)++;
+		if (blk[b].size >= asize)
+		{
+			if (policy == MM_FIT_NEXT)
+				rover[index] = b;
+			return b;
+		}
+		if (max_probes > 0 && ++n >= max_probes)
+			break;
+
+		b = blk[b].lnext;
+		if (b < 0 && start != list_head[index])
+			b = list_head[index];
+		if (b == start)
+			return -1;
+	}
+	if (b < 0 || index < N_LISTS - 1)
+		return -1;
+
+	for (n = 0, b = last_tail; b >= 0 && n < max_probes; n++)
+	{
+		(*probes)++;
+		if (blk[b].size < asize)
+			break;
+		fit = b;
+		b = blk[b].lprev;
+	}
+	return fit;
+}
+
+/*
+ * find_fit - Search the bins from asize's own class upward
+ */
+static int find_fit(size_t asize)
+{
+	int index = get_list_index(asize);
+	int b = -1;
+	unsigned long probes = 0;
+
+	for (; index < N_LISTS && b < 0; index++)
+		b = search_list(index, asize, &probes);
+
+	fit.searches++;
+	fit.probes += probes;
+	if (probes > fit.max_probes)
+		fit.max_probes = probes;
+	return b;
+}
+
+/*
+ * sim_init - Start an empty heap, laid out as mm_init does: padding,
+ * prologue and epilogue, then one CHUNKSIZE free block
+ */
+static void sim_init(void)
+{
+	int i;
+
+	nblk = 0;
+	free_ids = -1;
+	last = -1;
+	heap_brk = 4 * WSIZE;
+	for (i = 0; i < N_LISTS; i++)
+		list_head[i] = rover[i] = -1;
+	last_tail = -1;
+	memset(&fit, 0, sizeof(fit));
+	extend_heap(CHUNKSIZE);
+}
+
+/*
+ * sim_malloc - Return the block id for a size byte request (-1 for 0)
+ */
+static int sim_malloc(size_t size)
+{
+	size_t asize;
+	int b;
+
+	if (size == 0)
+		return -1;
+	asize = (size <= DSIZE) ? 2 * DSIZE : ALIGN(size + DSIZE);
+
+	if ((b = find_fit(asize)) < 0)
+		b = extend_heap(asize > CHUNKSIZE ? asize : CHUNKSIZE);
+	place(b, asize);
+	return b;
+}
+
+/*
+ * sim_free - Free block b
+ */
+static void sim_free(int b)
+{
+	if (b >= 0)
+		coalesce(b);
+}
+
+/*
+ * sim_free_stats - Same figures as mm_get_free_stats
+ */
+static void sim_free_stats(mm_free_stats_t *stats)
+{
+	unsigned long n;
+	int i, b;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < N_LISTS; i++)
+	{
+		for (n = 0, b = list_head[i]; b >= 0; b = blk[b].lnext, n++)
+			stats->bytes += blk[b].size;
+		stats->blocks += n;
+		if (n > stats->max_list)
+			stats->max_list = n;
+	}
+}
+
+/*
+ * sim_trace - Replay a trace on the simulated heap
+ */
+static void sim_trace(trace_t *trace, simstats_t *st)
+{
+	int *ids;
+	int i, index;
+	long total = 0, max_total = 0;
+	size_t size;
+
+	if ((ids = malloc(trace->num_ids * sizeof(int))) == NULL)
+		unix_error("malloc failed in sim_trace");
+	sim_init();
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			ids[index] = sim_malloc(size);
+			trace->block_sizes[index] = size;
+			total += size;
+			break;
+		case REALLOC: /* mm_realloc: allocate, copy, then free */
+			if (size == 0)
+			{
+				sim_free(ids[index]);
+				ids[index] = -1;
+			}
+			else
+			{
+				int b = sim_malloc(size);
+
+				sim_free(ids[index]);
+				ids[index] = b;
+			}
+			total += (long)size - (long)trace->block_sizes[index];
+			trace->block_sizes[index] = size;
+			break;
+		case FREE:
+			sim_free(ids[index]);
+			ids[index] = -1;
+			total -= trace->block_sizes[index];
+			break;
+		}
+		if (total > max_total)
+			max_total = total;
+	}
+
+	st->peak_heap = heap_brk;
+	st->util = (double)max_total / (double)heap_brk;
+	st->fit = fit;
+	sim_free_stats(&st->fs);
+	free(ids);
+}
+
+/*
+ * real_trace - Replay a trace through mm.c, collecting the same figures.
+ * Returns -1 if mm.c runs out of its simulated heap.
+ */
+static int real_trace(trace_t *trace, simstats_t *st)
+{
+	int i, index;
+	long total = 0, max_total = 0;
+	size_t size;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		unix_error("mm_init failed in real_trace");
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			if ((trace->blocks[index] = mm_malloc(size)) == NULL && size > 0)
+				return -1;
+			trace->block_sizes[index] = size;
+			total += size;
+			break;
+		case REALLOC:
+			if ((trace->blocks[index] = mm_realloc(trace->blocks[index], size)) == NULL &&
+				size > 0)
+				return -1;
+			total += (long)size - (long)trace->block_sizes[index];
+			trace->block_sizes[index] = size;
+			break;
+		case FREE:
+			mm_free(trace->blocks[index]);
+			total -= trace->block_sizes[index];
+			break;
+		}
+		if (total > max_total)
+			max_total = total;
+	}
+
+	st->peak_heap = mem_heappeak();
+	st->util = (double)max_total / (double)mem_heappeak();
+	mm_get_fit_stats(&st->fit);
+	mm_get_free_stats(&st->fs);
+	return 0;
+}
+
+/*
+ * same_stats - Do a simulated and a real run agree?
+ */
+static int same_stats(simstats_t *a, simstats_t *b)
+{
+	return a->peak_heap == b->peak_heap &&
+		   a->fit.searches == b->fit.searches &&
+		   a->fit.probes == b->fit.probes &&
+		   a->fit.max_probes == b->fit.max_probes &&
+		   a->fs.blocks == b->fs.blocks &&
+		   a->fs.bytes == b->fs.bytes &&
+		   a->fs.max_list == b->fs.max_list;
+}
+
+int main(int argc, char **argv)
+{
+	char **tracefiles = default_tracefiles;
+	char *onefile[2] = {NULL, NULL};
+	int check = 0, mismatches = 0, offline_bound = 0;
+	int i, c;
+	trace_t *trace;
+	simstats_t sim, real;
+	bound_t bound;
+	double secs, ops = 0, simsecs = 0;
+
+	while ((c = getopt(argc, argv, "f:t:F:K:cBh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'f': /* Use one specific trace file only (relative to curr dir) */
+			onefile[0] = optarg;
+			tracefiles = onefile;
+			strcpy(tracedir, "./");
+			break;
+		case 't': /* Directory where the traces are located */
+			if (onefile[0] != NULL)
+				break;
+			strcpy(tracedir, optarg);
+			if (tracedir[strlen(tracedir) - 1] != '/')
+				strcat(tracedir, "/");
+			break;
+		case 'F':
+			if (!strcmp(optarg, "best"))
+				policy = MM_FIT_BEST;
+			else if (!strcmp(optarg, "first"))
+				policy = MM_FIT_FIRST;
+			else if (!strcmp(optarg, "next"))
+				policy = MM_FIT_NEXT;
+			else
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'K':
+			max_probes = atoi(optarg);
+			break;
+		case 'c':
+			check = 1;
+			break;
+		case 'B':
+			offline_bound = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (check)
+	{
+		mem_init();
+		mm_set_fit_policy(policy, max_probes);
+	}
+
+	printf("%-22s %9s %6s %9s %9s %11s %8s", "trace", "ops", "util",
+		   "heap KB", "free blks", "probes", "Mops/s");
+	if (offline_bound)
+		printf(" %9s %9s %9s", "lower KB", "packed KB", "vs packed");
+	printf("%s\n", check ? "  mm.c" : "");
+	for (i = 0; tracefiles[i] != NULL; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+
+		secs = ftimer_now();
+		sim_trace(trace, &sim);
+		secs = ftimer_now() - secs;
+		simsecs += secs;
+		ops += trace->num_ops;
+
+		printf("%-22s %9d %5.1f%% %9.1f %9lu %11lu %8.1f",
+			   tracefiles[i], trace->num_ops, sim.util * 100,
+			   sim.peak_heap / 1024.0, sim.fs.blocks, sim.fit.probes,
+			   (secs > 0) ? trace->num_ops / secs / 1e6 : 0.0);
+		if (offline_bound)
+		{
+			trace_bound(trace, &bound);
+			printf(" %9.1f %9.1f %8.0f%%", bound.lower / 1024.0,
+				   bound.packed / 1024.0, 100.0 * bound.packed / sim.peak_heap);
+		}
+		if (check)
+		{
+			if (real_trace(trace, &real) < 0)
+				printf("  mm.c ran out of heap");
+			else if (same_stats(&sim, &real))
+				printf("  same");
+			else
+			{
+				printf("  DIFFERS: util %.1f%%, heap %.1f KB, %lu free blks, %lu probes",
+					   real.util * 100, real.peak_heap / 1024.0,
+					   real.fs.blocks, real.fit.probes);
+				mismatches++;
+			}
+		}
+		printf("\n");
+		free_trace(trace);
+	}
+
+	printf("Simulated %.0f ops in %.3f secs (%.1f Mops/s)\n",
+		   ops, simsecs, (simsecs > 0) ? ops / simsecs / 1e6 : 0.0);
+	if (check)
+	{
+		printf("%d trace(s) differ from mm.c\n", mismatches);
+		mem_deinit();
+	}
+	free(blk);
+	return mismatches ? 2 : 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mmsim [-cBh] [-f <file>] [-t <dir>] [-F <policy>] [-K <n>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-B         Compare the heap with offline bounds.\n");
+	fprintf(stderr, "\t-c         Cross-check every trace against mm.c.\n");
+	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-F <pol>   Placement policy: best (default), first or next.\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-K <n>     Give up on a bin after <n> probes (0 = never).\n");
+	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
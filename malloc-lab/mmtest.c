@@ -0,0 +1,590 @@
+/*
+ * mmtest.c - Exercise the parts of mm.c that the trace driver never calls
+ *
+ * Each test starts from a fresh heap, drives one API through mm.h and
+ * checks the heap with mm_check afterwards. A test that does not apply
+ * to the mm.c variant this was built with is reported as skipped. The
+ * exit status is 1 if any test failed, so "make check" can run it for
+ * every build variant.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+#define NHANDLES 64 /* handles allocated by test_handles */
+#define NBLOCKS 4096 /* most blocks the budget tests allocate */
+#define PAGE 4096	 /* mm.c's CHUNKSIZE */
+#define NPERSIST 256 /* blocks test_persist leaves in the heap file */
+#define NPROCS 4	 /* processes test_shared forks */
+#define NSHARED 512	 /* blocks each of them allocates */
+
+#define PASS 0
+#define FAIL 1
+#define SKIP 2
+
+/* A test returns PASS, FAIL or SKIP */
+typedef struct
+{
+	char *name;
+	int (*fn)(void);
+} test_t;
+
+/* Blocks the pressure callback may free, and what it was called with */
+typedef struct
+{
+	void *victims[NBLOCKS];
+	int nvictims;
+	int handles;  /* victims are handles, freed with mm_hfree */
+	int free_on;  /* level at which to free the victims (0 = never) */
+	int calls[3]; /* calls per level */
+} pressure_t;
+
+static int verbose = 0;
+
+static int test_handles(void);
+static int test_budget_soft(void);
+static int test_budget_hard(void);
+static int test_budget_tail(void);
+static int test_budget_handles(void);
+static int test_persist(void);
+static int test_shared(void);
+
+static test_t tests[] = {
+	{"handles", test_handles},
+	{"budget-soft", test_budget_soft},
+	{"budget-hard", test_budget_hard},
+	{"budget-tail", test_budget_tail},
+	{"budget-hfree", test_budget_handles},
+	{"persist", test_persist},
+	{"shared", test_shared},
+};
+
+#define NTESTS (int)(sizeof(tests) / sizeof(tests[0]))
+
+/*
+ * fail - Report why the current test failed and return FAIL
+ */
+static int fail(char *msg)
+{
+	if (verbose)
+		fprintf(stderr, "  %s\n", msg);
+	return FAIL;
+}
+
+/*
+ * fresh_heap - Throw away the heap and start an empty one with no budget.
+ * The budget is reset after mm_init, since setting it takes the heap
+ * lock, which in a SHARED_HEAP build lives in the heap just remapped.
+ */
+static int fresh_heap(void)
+{
+	mem_reset_brk();
+	if (mm_init() < 0)
+		return -1;
+	mm_set_budget(0, 0);
+	mm_set_pressure_callback(NULL, NULL);
+	return 0;
+}
+
+/*
+ * fill, filled - Write and check a pattern that depends on the block
+ */
+static void fill(unsigned char *p, size_t size, int id)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		p[i] = (unsigned char)(id * 31 + i);
+}
+
+static int filled(unsigned char *p, size_t size, int id)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		if (p[i] != (unsigned char)(id * 31 + i))
+			return 0;
+	return 1;
+}
+
+/*
+ * test_handles - Allocate handle blocks between ordinary ones, free
+ * every other handle, pin one, and compact. Unpinned blocks must move
+ * with their contents, the pinned one must stay put, and the heap must
+ * check out after each step.
+ */
+static int test_handles(void)
+{
+	mm_handle_t h[NHANDLES];
+	void *plain[NHANDLES], *before[NHANDLES];
+	size_t size[NHANDLES];
+	unsigned char *p, *pinned;
+	int i, moved = 0, steps = 0;
+
+	if (fresh_heap() < 0)
+		return fail("mm_init failed");
+	if ((h[0] = mm_halloc(16)) == NULL)
+		return SKIP; /* No handles in this build (SHARED_HEAP) */
+	mm_hfree(h[0]);
+
+	for (i = 0; i < NHANDLES; i++)
+	{
+		size[i] = 16 + 24 * (i % 7);
+		if ((h[i] = mm_halloc(size[i])) == NULL)
+			return fail("mm_halloc failed");
+		p = mm_hlock(h[i]);
+		fill(p, size[i], i);
+		mm_hunlock(h[i]);
+		if (i % 8 == 0 && (plain[i] = mm_malloc(40)) == NULL)
+			return fail("mm_malloc failed");
+	}
+	if (mm_check() != 0)
+		return fail("heap inconsistent after mm_halloc");
+
+	for (i = 0; i < NHANDLES; i += 2)
+		mm_hfree(h[i]);
+	if (mm_check() != 0)
+		return fail("heap inconsistent after mm_hfree");
+
+	pinned = mm_hlock(h[NHANDLES - 1]);
+	for (i = 1; i < NHANDLES; i += 2)
+		before[i] = *h[i];
+	while (mm_compact(4))
+	{
+		if (++steps > 100000)
+			return fail("mm_compact never finished");
+		if (mm_check() != 0)
+			return fail("heap inconsistent during mm_compact");
+	}
+	for (i = 1; i < NHANDLES; i += 2)
+		if (*h[i] != before[i])
+			moved++;
+	if (mm_check() != 0)
+		return fail("heap inconsistent after mm_compact");
+	if (moved == 0)
+		return fail("mm_compact moved nothing");
+	if (*h[NHANDLES - 1] != pinned)
+		return fail("mm_compact moved a pinned block");
+	mm_hunlock(h[NHANDLES - 1]);
+
+	for (i = 1; i < NHANDLES; i += 2)
+	{
+		p = mm_hlock(h[i]);
+		if (!filled(p, size[i], i))
+			return fail("payload changed when its block moved");
+		mm_hunlock(h[i]);
+		mm_hfree(h[i]);
+	}
+	for (i = 0; i < NHANDLES; i += 8)
+		mm_free(plain[i]);
+	if (mm_check() != 0)
+		return fail("heap inconsistent after freeing everything");
+	return PASS;
+}
+
+/*
+ * on_pressure - Pressure callback for the budget tests
+ */
+static void on_pressure(int level, size_t heapsize, void *arg)
+{
+	pressure_t *pr = arg;
+
+	pr->calls[level]++;
+	if (level == pr->free_on)
+	{
+		while (pr->nvictims > 0)
+			if (pr->handles)
+				mm_hfree(pr->victims[--pr->nvictims]);
+			else
+				mm_free(pr->victims[--pr->nvictims]);
+	}
+}
+
+/*
+ * test_budget_soft - The callback frees everything when the heap is
+ * about to pass the soft watermark. The allocation that triggered it
+ * must then be served from the freed blocks without growing the heap.
+ */
+static int test_budget_soft(void)
+{
+	static pressure_t pr;
+	size_t before;
+	void *p;
+	int i;
+
+	if (fresh_heap() < 0)
+		return fail("mm_init failed");
+	memset(&pr, 0, sizeof(pr));
+	pr.free_on = MM_PRESSURE_SOFT;
+	mm_set_budget(mem_heapsize() + 4 * PAGE, 0);
+	mm_set_pressure_callback(on_pressure, &pr);
+
+	for (i = 0; i < NBLOCKS && pr.calls[MM_PRESSURE_SOFT] == 0; i++)
+	{
+		before = mem_heapsize();
+		if ((p = mm_malloc(1000)) == NULL)
+			return fail("mm_malloc failed under the soft watermark");
+		if (pr.calls[MM_PRESSURE_SOFT] > 0 && mem_heapsize() != before)
+			return fail("heap grew although the callback made room");
+		pr.victims[pr.nvictims++] = p;
+	}
+	if (pr.calls[MM_PRESSURE_SOFT] != 1 || pr.calls[MM_PRESSURE_HARD] != 0)
+		return fail("callback not run exactly once, at the soft level");
+	if (mm_check() != 0)
+		return fail("heap inconsistent");
+	return PASS;
+}
+
+/*
+ * test_budget_hard - Allocate until mm_malloc fails, keeping every other
+ * block and letting the callback free the rest at the hard watermark.
+ * The heap must never pass the hard watermark, and the kept blocks must
+ * survive the compaction that reclaiming runs.
+ */
+static int test_budget_hard(void)
+{
+	static pressure_t pr;
+	static void *kept[NBLOCKS];
+	size_t hard;
+	void *p;
+	int i, nkept = 0;
+
+	if (fresh_heap() < 0)
+		return fail("mm_init failed");
+	memset(&pr, 0, sizeof(pr));
+	pr.free_on = MM_PRESSURE_HARD;
+	hard = mem_heapsize() + 16 * PAGE;
+	mm_set_budget(mem_heapsize() + 4 * PAGE, hard);
+	mm_set_pressure_callback(on_pressure, &pr);
+
+	for (i = 0; i < NBLOCKS; i++)
+	{
+		if ((p = mm_malloc(1000)) == NULL)
+			break;
+		if (mem_heapsize() > hard)
+			return fail("heap grew past the hard watermark");
+		fill(p, 1000, i);
+		if (i % 2 == 0)
+			kept[nkept++] = p;
+		else
+			pr.victims[pr.nvictims++] = p;
+	}
+	if (i == NBLOCKS)
+		return fail("mm_malloc never failed at the hard watermark");
+	if (pr.calls[MM_PRESSURE_SOFT] == 0 || pr.calls[MM_PRESSURE_HARD] == 0)
+		return fail("callback not run at both levels");
+	for (i = 0; i < nkept; i++)
+		if (!filled(kept[i], 1000, 2 * i))
+			return fail("payload of a kept block changed");
+	if (mm_check() != 0)
+		return fail("heap inconsistent");
+	return PASS;
+}
+
+/*
+ * test_budget_tail - A request larger than the room left under the hard
+ * watermark still fits when reclaiming trims the free block at the top
+ * of the heap and the heap then grows by no more than the request.
+ */
+static int test_budget_tail(void)
+{
+	void *small, *p;
+
+	if (fresh_heap() < 0)
+		return fail("mm_init failed");
+	if ((small = mm_malloc(100)) == NULL)
+		return fail("mm_malloc failed");
+	/* The top of the first page is free; growing by one more is allowed */
+	mm_set_budget(0, mem_heapsize() + PAGE);
+	if ((p = mm_malloc(PAGE + PAGE / 2)) == NULL)
+		return fail("mm_malloc failed with a free tail in reach");
+	mm_free(p);
+	mm_free(small);
+	if (mm_check() != 0)
+		return fail("heap inconsistent");
+	return PASS;
+}
+
+/*
+ * test_budget_handles - The callback frees handles while mm_halloc is
+ * growing the heap for a new one. A handle slot is always free when
+ * mm_halloc starts, so it must take its slot after the callback has run,
+ * and no slot may be handed out twice afterwards.
+ */
+static int test_budget_handles(void)
+{
+	static pressure_t pr;
+	static mm_handle_t live[NBLOCKS];
+	mm_handle_t h;
+	int i, j, nlive = 0;
+
+	if (fresh_heap() < 0)
+		return fail("mm_init failed");
+	if ((h = mm_halloc(16)) == NULL)
+		return SKIP; /* No handles in this build (SHARED_HEAP) */
+	mm_hfree(h);
+	memset(&pr, 0, sizeof(pr));
+	pr.handles = 1;
+	pr.free_on = MM_PRESSURE_SOFT;
+	mm_set_budget(mem_heapsize() + 4 * PAGE, 0);
+	mm_set_pressure_callback(on_pressure, &pr);
+
+	for (i = 0; i < NBLOCKS / 2 && pr.calls[MM_PRESSURE_SOFT] == 0; i++)
+	{
+		if ((h = mm_halloc(1000)) == NULL)
+			return fail("mm_halloc failed under the soft watermark");
+		if (i % 2 == 0 || pr.calls[MM_PRESSURE_SOFT] > 0)
+			live[nlive++] = h;
+		else
+			pr.victims[pr.nvictims++] = h;
+		/* Leave a slot on the free list for the next mm_halloc */
+		if ((h = mm_halloc(16)) == NULL)
+			return fail("mm_halloc failed");
+		mm_hfree(h);
+	}
+	if (pr.calls[MM_PRESSURE_SOFT] == 0)
+		return fail("callback never run");
+
+	/* Take back every slot the callback freed, and then some */
+	for (i = 0; i < NBLOCKS / 4 && nlive < NBLOCKS; i++)
+		if ((live[nlive++] = mm_halloc(16)) == NULL)
+			return fail("mm_halloc failed");
+	for (i = 0; i < nlive; i++)
+		for (j = i + 1; j < nlive; j++)
+			if (live[i] == live[j])
+				return fail("mm_halloc handed out a live handle");
+	for (i = 0; i < nlive; i++)
+		mm_hfree(live[i]);
+	if (mm_check() != 0)
+		return fail("heap inconsistent");
+	return PASS;
+}
+
+/*
+ * test_persist - Build a heap in a file, register a root block, and sync
+ * and unmap it as a process would on exit. Then map the file again, at
+ * another address if possible, and check that mm_recover takes the heap
+ * back with the root and its contents intact and the free lists usable,
+ * and that mm_check rejects a root that is not a block.
+ * Only a SHARED_HEAP build can do this; others skip it.
+ */
+static int test_persist(void)
+{
+	char path[] = "/tmp/mmtestXXXXXX";
+	void *blocks[NPERSIST], *hole, *root;
+	int fd, i, r = PASS;
+
+	if ((fd = mkstemp(path)) < 0)
+		return fail("cannot create a heap file");
+	close(fd);
+	mem_deinit();
+	mem_init_file(path);
+	if (fresh_heap() < 0)
+	{
+		r = fail("mm_init failed");
+		goto out;
+	}
+	if (mm_attach() < 0)
+	{
+		r = SKIP; /* Not a SHARED_HEAP build */
+		goto out;
+	}
+
+	for (i = 0; i < NPERSIST; i++)
+	{
+		if ((blocks[i] = mm_malloc(16 + 8 * i)) == NULL)
+		{
+			r = fail("mm_malloc failed");
+			goto out;
+		}
+		fill(blocks[i], 16 + 8 * i, i);
+	}
+	for (i = 0; i < NPERSIST; i += 3)
+		mm_free(blocks[i]);
+	mm_set_root(blocks[1]);
+	if (mem_sync() < 0)
+	{
+		r = fail("mem_sync failed");
+		goto out;
+	}
+	mem_deinit();
+
+	/* Keep the old address taken so that the heap has to move */
+	hole = mmap(NULL, mem_pagesize() + MAX_HEAP, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mem_init_file(path);
+	if (hole != MAP_FAILED)
+		munmap(hole, mem_pagesize() + MAX_HEAP);
+
+	if (mm_recover() < 0)
+		r = fail("mm_recover rejected the heap");
+	else if ((root = mm_get_root()) == NULL)
+		r = fail("mm_get_root lost the root");
+	else if (!filled(root, 16 + 8, 1))
+		r = fail("root block contents changed");
+	else
+	{
+		for (i = 0; i < NPERSIST; i += 3)
+			if ((blocks[i] = mm_malloc(16 + 8 * i)) == NULL)
+				break;
+		if (i < NPERSIST || mm_check() != 0)
+			r = fail("recovered heap unusable");
+		/* A root that is not a block start must not pass */
+		mm_set_root((char *)root + 16);
+		if (r == PASS && mm_check() == 0)
+			r = fail("mm_check passed a root inside a block");
+		mm_set_root(root);
+	}
+
+out:
+	mem_deinit();
+	unlink(path);
+	mem_init();
+	return r;
+}
+
+/*
+ * shared_child - Body of one test_shared process: attach to the heap,
+ * from another address if possible, then allocate, check and free
+ * blocks while the other processes do the same. Returns the exit status.
+ */
+static int shared_child(const char *name, int id)
+{
+	static void *p[NSHARED];
+	void *hole;
+	int i;
+
+	mem_deinit();
+	hole = mmap(NULL, mem_pagesize() + MAX_HEAP, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mem_attach_shared(name);
+	if (hole != MAP_FAILED)
+		munmap(hole, mem_pagesize() + MAX_HEAP);
+	if (mm_attach() < 0)
+		return 1;
+
+	for (i = 0; i < NSHARED; i++)
+	{
+		if ((p[i] = mm_malloc(8 + 24 * (i % 11))) == NULL)
+			return 1;
+		fill(p[i], 8 + 24 * (i % 11), NPROCS * i + id);
+		if (i % 4 == 3)
+		{
+			mm_free(p[i - 2]);
+			p[i - 2] = NULL;
+		}
+	}
+	for (i = 0; i < NSHARED; i++)
+		if (p[i] != NULL)
+		{
+			if (!filled(p[i], 8 + 24 * (i % 11), NPROCS * i + id))
+				return 1;
+			mm_free(p[i]);
+		}
+	return 0;
+}
+
+/*
+ * test_shared - Fork processes that share one heap, each attached on its
+ * own, and let them allocate and free at the same time. Every process
+ * must see its own data intact, and the heap must check out once all
+ * have exited with the parent's block untouched. Only a SHARED_HEAP
+ * build can do this; others skip it.
+ */
+static int test_shared(void)
+{
+	char name[64];
+	pid_t pids[NPROCS];
+	void *mine;
+	int i, status, r = PASS;
+
+	sprintf(name, "/mmtest-%d", (int)getpid());
+	mem_deinit();
+	mem_init_shared(name);
+	if (fresh_heap() < 0)
+	{
+		r = fail("mm_init failed");
+		goto out;
+	}
+	if (mm_attach() < 0)
+	{
+		r = SKIP; /* Not a SHARED_HEAP build */
+		goto out;
+	}
+	if ((mine = mm_malloc(100)) == NULL)
+	{
+		r = fail("mm_malloc failed");
+		goto out;
+	}
+	fill(mine, 100, NPROCS * NSHARED);
+
+	fflush(NULL);
+	for (i = 0; i < NPROCS; i++)
+		if ((pids[i] = fork()) == 0)
+			_exit(shared_child(name, i));
+	for (i = 0; i < NPROCS; i++)
+		if (pids[i] < 0)
+			r = fail("fork failed");
+		else if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+				 WEXITSTATUS(status) != 0)
+			r = fail("a process sharing the heap failed");
+
+	if (r == PASS && !filled(mine, 100, NPROCS * NSHARED))
+		r = fail("another process changed the parent's block");
+	else if (r == PASS && mm_check() != 0)
+		r = fail("heap inconsistent after the processes exited");
+
+out:
+	mem_deinit();
+	shm_unlink(name);
+	mem_init();
+	return r;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mmtest [-hv]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-v         Say why a test failed.\n");
+}
+
+int main(int argc, char **argv)
+{
+	static char *result[] = {"ok", "FAILED", "skipped"};
+	int c, i, r, failed = 0;
+
+	while ((c = getopt(argc, argv, "hv")) != EOF)
+	{
+		switch (c)
+		{
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	mem_init();
+	for (i = 0; i < NTESTS; i++)
+	{
+		r = tests[i].fn();
+		printf("%-14s%s\n", tests[i].name, result[r]);
+		if (r == FAIL)
+			failed++;
+	}
+	mem_deinit();
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * replay.h - Traces compiled to C by trace2c, as linked into mmbench
+ *
+ * Each replay runs its trace as straight-line calls to mm.c, with the
+ * block pointers in a static array, so that timing it measures mm.c and
+ * not the driver's interpretation of the trace. The trace's ops are kept
+ * too, for mmbench to interpret the same trace the way mdriver does.
+ */
+#ifndef __REPLAY_H_
+#define __REPLAY_H_
+
+#include "trace.h"
+
+typedef struct
+{
+	char *name;			  /* trace file it was compiled from */
+	int num_ids;		  /* number of block ids */
+	int num_ops;		  /* number of ops */
+	const traceop_t *ops; /* the ops, for the interpreted replay */
+	void (*run)(void);	  /* the compiled replay (no mm_init) */
+} replay_t;
+
+/* The compiled traces, ending with one whose name is NULL */
+extern const replay_t replays[];
+
+#endif /* __REPLAY_H_ */
@@ -0,0 +1,150 @@
+/*
+ * trace.c - Read trace files into memory, and write them back out
+ *
+ * Shared by mdriver and the trace tools, so that they all agree on the
+ * trace format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+extern int verbose; /* -v option of the program */
+
+static void unix_error(char *msg);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+	FILE *tracefile;
+	trace_t *trace;
+	char type[MAXLINE];
+	char path[MAXLINE];
+	char msg[MAXLINE];
+	unsigned index, size;
+	unsigned max_index = 0;
+	unsigned op_index;
+
+	if (verbose > 1)
+		printf("Reading tracefile: %s\n", filename);
+
+	/* Allocate the trace record */
+	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+		unix_error("malloc 1 failed in read_trance");
+
+	/* Read the trace file header */
+	strcpy(path, tracedir);
+	strcat(path, filename);
+	if ((tracefile = fopen(path, "r")) == NULL)
+	{
+		sprintf(msg, "Could not open %s in read_trace", path);
+		unix_error(msg);
+	}
+	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(tracefile, "%d", &(trace->num_ids));
+	fscanf(tracefile, "%d", &(trace->num_ops));
+	fscanf(tracefile, "%d", &(trace->weight)); /* used by mdriver -l */
+
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops =
+			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		unix_error("malloc 2 failed in read_trace");
+
+	/* We'll keep an array of pointers to the allocated blocks here... */
+	if ((trace->blocks =
+			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		unix_error("malloc 3 failed in read_trace");
+
+	/* ... along with the corresponding byte sizes of each block */
+	if ((trace->block_sizes =
+			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+		unix_error("malloc 4 failed in read_trace");
+
+	/* read every request line in the trace file */
+	index = 0;
+	op_index = 0;
+	while (fscanf(tracefile, "%s", type) != EOF)
+	{
+		switch (type[0])
+		{
+		case 'a':
+			fscanf(tracefile, "%u %u", &index, &size);
+			trace->ops[op_index].type = ALLOC;
+			trace->ops[op_index].index = index;
+			trace->ops[op_index].size = size;
+			max_index = (index > max_index) ? index : max_index;
+			break;
+		case 'r':
+			fscanf(tracefile, "%u %u", &index, &size);
+			trace->ops[op_index].type = REALLOC;
+			trace->ops[op_index].index = index;
+			trace->ops[op_index].size = size;
+			max_index = (index > max_index) ? index : max_index;
+			break;
+		case 'f':
+			fscanf(tracefile, "%ud", &index);
+			trace->ops[op_index].type = FREE;
+			trace->ops[op_index].index = index;
+			break;
+		default:
+			fprintf(stderr, "Bogus type character (%c) in tracefile %s\n",
+					type[0], path);
+			exit(1);
+		}
+		op_index++;
+	}
+	fclose(tracefile);
+	assert(max_index == trace->num_ids - 1);
+	assert(trace->num_ops == op_index);
+
+	return trace;
+}
+
+/*
+ * write_trace - write a trace in the format read_trace reads
+ */
+void write_trace(FILE *fp, trace_t *trace)
+{
+	int i;
+	traceop_t *op;
+
+	fprintf(fp, "%d\n%d\n%d\n%d\n", trace->sugg_heapsize, trace->num_ids,
+			trace->num_ops, trace->weight);
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		op = &trace->ops[i];
+		if (op->type == FREE)
+			fprintf(fp, "f %d\n", op->index);
+		else
+			fprintf(fp, "%c %d %d\n", (op->type == ALLOC) ? 'a' : 'r',
+					op->index, op->size);
+	}
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+	free(trace->ops); /* free the three arrays... */
+	free(trace->blocks);
+	free(trace->block_sizes);
+	free(trace); /* and the trace record itself... */
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
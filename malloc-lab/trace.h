@@ -0,0 +1,43 @@
+/*
+ * trace.h - Trace files, as read by mdriver and the trace tools
+ *
+ * A trace starts with four header lines (suggested heap size, number of
+ * block ids, number of ops, weight), followed by one request per line:
+ * "a id size", "r id size" or "f id".
+ */
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct
+{
+	enum
+	{
+		ALLOC,
+		FREE,
+		REALLOC
+	} type;	   /* type of request */
+	int index; /* index for free() to use later */
+	int size;  /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct
+{
+	int sugg_heapsize;	 /* suggested heap size (unused) */
+	int num_ids;		 /* number of alloc/realloc ids */
+	int num_ops;		 /* number of distinct requests */
+	int weight;			 /* weight for this trace (mdriver -l) */
+	traceop_t *ops;		 /* array of requests */
+	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
+	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+} trace_t;
+
+trace_t *read_trace(char *tracedir, char *filename);
+void write_trace(FILE *fp, trace_t *trace);
+void free_trace(trace_t *trace);
+
+#endif /* __TRACE_H_ */
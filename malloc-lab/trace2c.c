@@ -0,0 +1,177 @@
+/*
+ * trace2c.c - Compile traces into C for mmbench
+ *
+ * Every trace becomes a function of straight-line calls,
+ *
+ *     p[3] = mm_malloc(2040);
+ *     p[3] = mm_realloc(p[3], 4072);
+ *     mm_free(p[3]);
+ *
+ * with the block pointers in one static array, and a table of its ops
+ * for the interpreted replay. Long traces are split into functions of
+ * CHUNK ops, so that the compiler is not handed one enormous function.
+ * The output defines replays[] (see replay.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+extern char *optarg;
+extern int optind;
+
+#include "trace.h"
+#include "config.h"
+
+#define MAXLINE 1024
+#define CHUNK 1000 /* ops per generated function */
+
+int verbose = 0; /* read by read_trace */
+
+/* Directory where default tracefiles are found */
+static char tracedir[MAXLINE] = TRACEDIR;
+
+/* The filenames of the default tracefiles */
+static char *default_tracefiles[] = {
+	DEFAULT_TRACEFILES, NULL};
+
+static void emit_trace(FILE *fp, trace_t *trace, int n);
+static void usage(void);
+static void unix_error(char *msg);
+
+/*
+ * emit_trace - Write the op table and the compiled replay of trace n
+ */
+static void emit_trace(FILE *fp, trace_t *trace, int n)
+{
+	traceop_t *op;
+	int i, c;
+
+	fprintf(fp, "\nstatic const traceop_t ops_%d[] = {\n", n);
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		op = &trace->ops[i];
+		fprintf(fp, "\t{%s, %d, %d},\n",
+				(op->type == ALLOC) ? "ALLOC" : (op->type == FREE) ? "FREE" : "REALLOC",
+				op->index, op->size);
+	}
+	fprintf(fp, "};\n");
+
+	for (c = 0; c * CHUNK < trace->num_ops; c++)
+	{
+		fprintf(fp, "\nstatic void run_%d_%d(void)\n{\n", n, c);
+		for (i = c * CHUNK; i < trace->num_ops && i < (c + 1) * CHUNK; i++)
+		{
+			op = &trace->ops[i];
+			if (op->type == ALLOC)
+				fprintf(fp, "\tp[%d] = mm_malloc(%d);\n", op->index, op->size);
+			else if (op->type == REALLOC)
+				fprintf(fp, "\tp[%d] = mm_realloc(p[%d], %d);\n",
+						op->index, op->index, op->size);
+			else
+				fprintf(fp, "\tmm_free(p[%d]);\n", op->index);
+		}
+		fprintf(fp, "}\n");
+	}
+
+	fprintf(fp, "\nstatic void run_%d(void)\n{\n", n);
+	for (c = 0; c * CHUNK < trace->num_ops; c++)
+		fprintf(fp, "\trun_%d_%d();\n", n, c);
+	fprintf(fp, "}\n");
+}
+
+int main(int argc, char **argv)
+{
+	char **tracefiles = default_tracefiles;
+	char *outfile = NULL;
+	trace_t *trace;
+	FILE *fp = stdout;
+	int i, c, max_ids = 1;
+
+	while ((c = getopt(argc, argv, "o:t:h")) != EOF)
+	{
+		switch (c)
+		{
+		case 'o': /* Write the C here instead of stdout */
+			outfile = optarg;
+			break;
+		case 't': /* Directory where the traces are located */
+			strcpy(tracedir, optarg);
+			if (tracedir[strlen(tracedir) - 1] != '/')
+				strcat(tracedir, "/");
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	/* Trace files named on the command line replace the default set */
+	if (optind < argc)
+	{
+		tracefiles = &argv[optind];
+		strcpy(tracedir, "");
+	}
+
+	if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL)
+		unix_error(outfile);
+
+	/* The pointer array must hold the ids of the largest trace */
+	for (i = 0; tracefiles[i] != NULL; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+		if (trace->num_ids > max_ids)
+			max_ids = trace->num_ids;
+		free_trace(trace);
+	}
+
+	fprintf(fp, "/* Generated by trace2c. Do not edit. */\n");
+	fprintf(fp, "#include \"mm.h\"\n#include \"replay.h\"\n");
+	fprintf(fp, "\nstatic void *p[%d];\n", max_ids);
+	for (i = 0; tracefiles[i] != NULL; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+		emit_trace(fp, trace, i);
+		free_trace(trace);
+	}
+
+	fprintf(fp, "\nconst replay_t replays[] = {\n");
+	for (i = 0; tracefiles[i] != NULL; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+		fprintf(fp, "\t{\"%s\", %d, %d, ops_%d, run_%d},\n", tracefiles[i],
+				trace->num_ids, trace->num_ops, i, i);
+		free_trace(trace);
+	}
+	fprintf(fp, "\t{NULL, 0, 0, NULL, NULL}};\n");
+
+	if (fp != stdout && fclose(fp) != 0)
+		unix_error(outfile);
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: trace2c [-h] [-o <file>] [-t <dir>] [<file> ...]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-o <file>  Write the C source to <file> (default stdout).\n");
+	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr, "With no files, the default traces are compiled.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
@@ -0,0 +1,543 @@
+/*
+ * tracehunt.c - Search for traces that mm.c handles badly
+ *
+ * A hill climb over traces. Starting from a trace file (-f) or a random
+ * trace, tracehunt applies one random mutation at a time and keeps the
+ * new trace if mm.c does at least as badly on it. The mutations keep the
+ * trace well formed and balanced:
+ *
+ *   - resize an alloc or realloc (halve, double, or pick a new size)
+ *   - move an alloc earlier or later, up to the block's next op
+ *   - move a free earlier or later, after the block's last other op
+ *   - add a block (an alloc and a later free), or delete one
+ *
+ * The objective (-O) is one of
+ *
+ *   frag    peak heap over peak live payload, the payload counted as at
+ *           least -m KB so that tiny traces, whose heap is all first
+ *           chunk, do not win by default
+ *   probes  the longest single find_fit search (blocks examined)
+ *   latency the slowest single op, in ns (each op's best of -r runs)
+ *
+ * The worst trace found is written to <dir>/<objective>-<seed>.rep, by
+ * default in traces/worst, the regression corpus of such traces.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+extern char *optarg;
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+#include "ftimer.h"
+#include "config.h"
+
+#define MAXLINE 1024
+#define MAX_LIVE (MAX_HEAP / 8) /* payload cap, leaving mm.c room to waste */
+
+/* Objectives */
+#define OBJ_FRAG 0
+#define OBJ_PROBES 1
+#define OBJ_LATENCY 2
+
+static char *obj_names[] = {"frag", "probes", "latency"};
+
+int verbose = 0; /* read by read_trace */
+
+static int objective = OBJ_FRAG;
+static int max_ops = 2000;	  /* mutations never grow a trace past this */
+static int max_size = 16384;  /* largest size a mutation picks */
+static long min_live = 256 * 1024; /* payload floor for frag */
+static int runs = 3;
+static int fit_policy = MM_FIT_BEST;
+static int fit_max_probes = 0;
+
+static trace_t *new_trace(int room, int num_ids);
+static trace_t *copy_trace(trace_t *trace);
+static trace_t *random_trace(int nops);
+static int mutate(trace_t *trace);
+static void insert_op(trace_t *trace, int pos, traceop_t op);
+static void delete_op(trace_t *trace, int pos);
+static int find_op(trace_t *trace, int from, int step, int index);
+static double evaluate(trace_t *trace);
+static void compact_ids(trace_t *trace);
+static void usage(void);
+static void unix_error(char *msg);
+
+/*
+ * new_trace - An empty trace with room for room ops
+ */
+static trace_t *new_trace(int room, int num_ids)
+{
+	trace_t *trace;
+
+	if ((trace = calloc(1, sizeof(trace_t))) == NULL ||
+		(trace->ops = malloc((room + 2) * sizeof(traceop_t))) == NULL)
+		unix_error("malloc failed in new_trace");
+	trace->num_ids = num_ids;
+	trace->weight = 1;
+	return trace;
+}
+
+/*
+ * copy_trace - A copy of trace, with room to grow to max_ops ops
+ */
+static trace_t *copy_trace(trace_t *trace)
+{
+	trace_t *copy = new_trace(max_ops, trace->num_ids);
+
+	copy->num_ops = trace->num_ops;
+	copy->sugg_heapsize = trace->sugg_heapsize;
+	copy->weight = trace->weight;
+	memcpy(copy->ops, trace->ops, trace->num_ops * sizeof(traceop_t));
+	return copy;
+}
+
+/*
+ * random_trace - A balanced trace of about nops ops: allocs of random
+ * sizes while few blocks are live, random frees while many are
+ */
+static trace_t *random_trace(int nops)
+{
+	trace_t *trace = new_trace(max_ops, 0);
+	int *live, nlive = 0, i, j;
+
+	if ((live = malloc(nops * sizeof(int))) == NULL)
+		unix_error("malloc failed in random_trace");
+	for (i = 0; i + nlive < nops; i++)
+	{
+		traceop_t *op = &trace->ops[trace->num_ops++];
+
+		if (nlive == 0 || random() % nops >= (unsigned)nlive * 4)
+		{
+			op->type = ALLOC;
+			op->index = trace->num_ids++;
+			op->size = 1 + random() % max_size;
+			live[nlive++] = op->index;
+		}
+		else
+		{
+			j = random() % nlive;
+			op->type = FREE;
+			op->index = live[j];
+			op->size = 0;
+			live[j] = live[--nlive];
+		}
+	}
+	for (j = 0; j < nlive; j++)
+	{
+		trace->ops[trace->num_ops].type = FREE;
+		trace->ops[trace->num_ops].index = live[j];
+		trace->ops[trace->num_ops++].size = 0;
+	}
+	free(live);
+	return trace;
+}
+
+static void insert_op(trace_t *trace, int pos, traceop_t op)
+{
+	memmove(&trace->ops[pos + 1], &trace->ops[pos],
+			(trace->num_ops - pos) * sizeof(traceop_t));
+	trace->ops[pos] = op;
+	trace->num_ops++;
+}
+
+static void delete_op(trace_t *trace, int pos)
+{
+	memmove(&trace->ops[pos], &trace->ops[pos + 1],
+			(trace->num_ops - pos - 1) * sizeof(traceop_t));
+	trace->num_ops--;
+}
+
+/*
+ * find_op - Position of the next op of block index from op from on, in
+ * direction step, or -1 (or num_ops) if there is none
+ */
+static int find_op(trace_t *trace, int from, int step, int index)
+{
+	int i;
+
+	for (i = from; i >= 0 && i < trace->num_ops; i += step)
+		if (trace->ops[i].index == index)
+			return i;
+	return i;
+}
+
+/*
+ * mutate - Apply one random mutation to trace. Returns 0 if the one
+ * drawn does not apply (the trace is then unchanged).
+ */
+static int mutate(trace_t *trace)
+{
+	traceop_t op;
+	int pos, lo, hi, n = trace->num_ops;
+
+	if (n == 0)
+		return 0;
+	pos = random() % n;
+	op = trace->ops[pos];
+
+	switch (random() % 5)
+	{
+	case 0: /* resize */
+		if (op.type == FREE)
+			return 0;
+		switch (random() % 3)
+		{
+		case 0:
+			op.size = (op.size > 1) ? op.size / 2 : 1;
+			break;
+		case 1:
+			op.size = (op.size < max_size / 2) ? op.size * 2 : max_size;
+			break;
+		default:
+			op.size = 1 + random() % max_size;
+		}
+		trace->ops[pos].size = op.size;
+		return 1;
+
+	case 1: /* move the alloc or the free at pos within its block's ops */
+		if (op.type == ALLOC)
+		{
+			lo = 0;
+			hi = find_op(trace, pos + 1, 1, op.index); /* next op of the block */
+		}
+		else if (op.type == FREE)
+		{
+			lo = find_op(trace, pos - 1, -1, op.index) + 1; /* after its last op */
+			hi = n;
+		}
+		else
+			return 0;
+		delete_op(trace, pos);
+		hi--; /* everything past pos moved down */
+		insert_op(trace, lo + random() % (hi - lo + 1), op);
+		return 1;
+
+	case 2: /* add a block */
+		if (n + 2 > max_ops)
+			return 0;
+		lo = random() % (n + 1);
+		hi = lo + 1 + random() % (n - lo + 1);
+		op.type = ALLOC;
+		op.index = trace->num_ids++;
+		op.size = 1 + random() % max_size;
+		insert_op(trace, lo, op);
+		op.type = FREE;
+		op.size = 0;
+		insert_op(trace, hi, op);
+		return 1;
+
+	case 3: /* delete the block of the op at pos */
+		for (lo = n - 1; lo >= 0; lo--)
+			if (trace->ops[lo].index == op.index)
+				delete_op(trace, lo);
+		return 1;
+
+	default: /* grow or shrink a block's lifetime by one op */
+		if (op.type != FREE)
+			return 0;
+		lo = find_op(trace, pos - 1, -1, op.index) + 1;
+		hi = (random() % 2) ? pos + 1 : pos - 1;
+		if (hi < lo || hi >= n)
+			return 0;
+		trace->ops[pos] = trace->ops[hi];
+		trace->ops[hi] = op;
+		return 1;
+	}
+}
+
+/*
+ * evaluate - Replay the trace with mm.c and score it under the
+ * objective; higher is worse for mm.c. Returns -1 if the trace does not
+ * fit in the heap.
+ */
+static double evaluate(trace_t *trace)
+{
+	static double *best;
+	static int nbest;
+	mm_fit_stats_t fs;
+	double start, worst = 0;
+	long live = 0, peak = 0;
+	int i, r, id;
+
+	if ((trace->blocks = calloc(trace->num_ids + 1, sizeof(char *))) == NULL ||
+		(trace->block_sizes = calloc(trace->num_ids + 1, sizeof(size_t))) == NULL)
+		unix_error("malloc failed in evaluate");
+
+	/* Reject traces whose payload leaves mm.c too little room */
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		id = trace->ops[i].index;
+		live -= trace->block_sizes[id];
+		trace->block_sizes[id] = (trace->ops[i].type == FREE) ? 0 : trace->ops[i].size;
+		live += trace->block_sizes[id];
+		if (live > peak)
+			peak = live;
+	}
+	if (peak > MAX_LIVE)
+		worst = -1;
+
+	if (nbest < trace->num_ops)
+	{
+		nbest = max_ops + 2;
+		if ((best = realloc(best, nbest * sizeof(double))) == NULL)
+			unix_error("malloc failed in evaluate");
+	}
+	for (r = 0; worst >= 0 && r < (objective == OBJ_LATENCY ? runs : 1); r++)
+	{
+		mem_reset_brk();
+		if (mm_init() < 0)
+		{
+			worst = -1;
+			break;
+		}
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			traceop_t *op = &trace->ops[i];
+			char *p = NULL;
+
+			start = (objective == OBJ_LATENCY) ? ftimer_now() : 0;
+			switch (op->type)
+			{
+			case ALLOC:
+				p = trace->blocks[op->index] = mm_malloc(op->size);
+				break;
+			case REALLOC:
+				p = trace->blocks[op->index] = mm_realloc(trace->blocks[op->index], op->size);
+				break;
+			case FREE:
+				mm_free(trace->blocks[op->index]);
+				p = trace->blocks[op->index] = (char *)1;
+				break;
+			}
+			if (objective == OBJ_LATENCY)
+			{
+				double secs = ftimer_now() - start;
+
+				if (r == 0 || secs < best[i])
+					best[i] = secs;
+			}
+			if (p == NULL)
+			{
+				worst = -1;
+				break;
+			}
+		}
+	}
+
+	if (worst >= 0)
+	{
+		if (objective == OBJ_FRAG)
+			worst = (double)mem_heappeak() / (peak > min_live ? peak : min_live);
+		else if (objective == OBJ_PROBES)
+		{
+			mm_get_fit_stats(&fs);
+			worst = fs.max_probes;
+		}
+		else
+			for (i = 0; i < trace->num_ops; i++)
+				if (best[i] * 1e9 > worst)
+					worst = best[i] * 1e9;
+	}
+	free(trace->blocks);
+	free(trace->block_sizes);
+	trace->blocks = NULL;
+	trace->block_sizes = NULL;
+	return worst;
+}
+
+/*
+ * compact_ids - Renumber the ids in order of first use, dropping those
+ * of deleted blocks
+ */
+static void compact_ids(trace_t *trace)
+{
+	int *newid, i, n = 0;
+
+	if ((newid = malloc((trace->num_ids + 1) * sizeof(int))) == NULL)
+		unix_error("malloc failed in compact_ids");
+	for (i = 0; i < trace->num_ids; i++)
+		newid[i] = -1;
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		if (newid[trace->ops[i].index] < 0)
+			newid[trace->ops[i].index] = n++;
+		trace->ops[i].index = newid[trace->ops[i].index];
+	}
+	trace->num_ids = n;
+	free(newid);
+}
+
+int main(int argc, char **argv)
+{
+	char *infile = NULL, *dir = "traces/worst";
+	char path[MAXLINE];
+	int iters = 2000, seed = 1;
+	int i, c, kept = 0;
+	trace_t *cur, *cand, *trace;
+	double score, cand_score;
+	FILE *fp;
+
+	while ((c = getopt(argc, argv, "f:O:i:n:z:m:r:s:d:F:K:vh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'f': /* Start from this trace */
+			infile = optarg;
+			break;
+		case 'O':
+			for (objective = 0; objective < 3; objective++)
+				if (!strcmp(optarg, obj_names[objective]))
+					break;
+			if (objective == 3)
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'i':
+			iters = atoi(optarg);
+			break;
+		case 'n':
+			max_ops = atoi(optarg);
+			break;
+		case 'z':
+			max_size = atoi(optarg);
+			break;
+		case 'm':
+			min_live = atol(optarg) * 1024;
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'd': /* Corpus directory */
+			dir = optarg;
+			break;
+		case 'F': /* Placement policy for mm.c */
+			if (!strcmp(optarg, "best"))
+				fit_policy = MM_FIT_BEST;
+			else if (!strcmp(optarg, "first"))
+				fit_policy = MM_FIT_FIRST;
+			else if (!strcmp(optarg, "next"))
+				fit_policy = MM_FIT_NEXT;
+			else
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'K': /* Give up on a bin after this many probes */
+			fit_max_probes = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (max_ops < 2 || max_size < 1 || runs < 1)
+	{
+		usage();
+		exit(1);
+	}
+
+	srandom(seed);
+	mem_init();
+	mm_set_fit_policy(fit_policy, fit_max_probes); /* For every mm_init */
+	if (infile != NULL)
+	{
+		trace = read_trace("", infile);
+		if (trace->num_ops > max_ops)
+			max_ops = trace->num_ops;
+		cur = copy_trace(trace);
+		free_trace(trace);
+	}
+	else
+		cur = random_trace(max_ops / 2);
+	if ((score = evaluate(cur)) < 0)
+	{
+		printf("tracehunt: the starting trace does not fit in the heap\n");
+		exit(1);
+	}
+	if (verbose)
+		printf("start: %s %.2f (%d ops)\n", obj_names[objective], score, cur->num_ops);
+
+	/* Hill climb, taking sideways steps too to cross plateaus */
+	for (i = 0; i < iters; i++)
+	{
+		cand = copy_trace(cur);
+		if (!mutate(cand) || (cand_score = evaluate(cand)) < score)
+		{
+			free(cand->ops);
+			free(cand);
+			continue;
+		}
+		if (verbose && cand_score > score)
+			printf("iter %d: %s %.2f (%d ops)\n", i, obj_names[objective],
+				   cand_score, cand->num_ops);
+		kept++;
+		score = cand_score;
+		free(cur->ops);
+		free(cur);
+		cur = cand;
+	}
+
+	compact_ids(cur);
+	snprintf(path, MAXLINE, "%s/%s-%d.rep", dir, obj_names[objective], seed);
+	if ((fp = fopen(path, "w")) == NULL)
+		unix_error(path);
+	write_trace(fp, cur);
+	fclose(fp);
+	printf("%s: %s %.2f, %d ops (%d of %d mutations kept)\n", path,
+		   obj_names[objective], score, cur->num_ops, kept, iters);
+
+	free(cur->ops);
+	free(cur);
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracehunt [-hv] [-f <file>] [-O frag|probes|latency] [-i <iters>]\n");
+	fprintf(stderr, "                 [-n <ops>] [-z <size>] [-m <KB>] [-r <runs>] [-s <seed>]\n");
+	fprintf(stderr, "                 [-d <dir>] [-F <policy>] [-K <probes>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-d <dir>     Save the worst trace in <dir> (default traces/worst).\n");
+	fprintf(stderr, "\t-f <file>    Start from <file> instead of a random trace.\n");
+	fprintf(stderr, "\t-F <policy>  Run mm.c with placement policy best, first or next.\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-i <iters>   Try <iters> mutations (default 2000).\n");
+	fprintf(stderr, "\t-K <probes>  Give up on an mm.c bin after <probes> probes.\n");
+	fprintf(stderr, "\t-m <KB>      Count at least <KB> of payload for frag (default 256).\n");
+	fprintf(stderr, "\t-n <ops>     Grow traces to at most <ops> ops (default 2000).\n");
+	fprintf(stderr, "\t-O <obj>     Maximize frag, probes or latency (default frag).\n");
+	fprintf(stderr, "\t-r <runs>    Time each op's best of <runs> runs for latency.\n");
+	fprintf(stderr, "\t-s <seed>    Seed the random mutations (default 1).\n");
+	fprintf(stderr, "\t-v           Report each improvement.\n");
+	fprintf(stderr, "\t-z <size>    Pick request sizes up to <size> (default 16384).\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
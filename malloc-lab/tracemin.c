@@ -0,0 +1,596 @@
+/*
+ * tracemin.c - Shrink a trace while it still shows a problem
+ *
+ * Delta debugging (ddmin) over a trace: tracemin removes ever smaller
+ * sets of blocks, keeping each removal after which the problem is still
+ * there, until no single set can go. A block is removed with all of its
+ * ops (alloc, reallocs and free), so the trace stays well formed; a
+ * second pass then drops single reallocs. The result is a small trace,
+ * with its ids renumbered, written to the -o file.
+ *
+ * The problem (the predicate) is one of
+ *
+ *   -e          mm.c fails on the trace: a malloc or realloc returns NULL
+ *               or a block outside the heap or misaligned, a payload is
+ *               overwritten, realloc loses data, mm_check fails at the
+ *               end, or mm.c crashes or runs longer than TIMEOUT seconds
+ *   -u <pct>    utilization (peak payload / peak heap) is below pct, while
+ *               the heap still grows to -m KB (by default, half the heap
+ *               of the whole trace; without a floor, any tiny trace would
+ *               do, since mm.c's first chunk dwarfs its payload)
+ *   -l <ns>     mm.c spends more than ns per op (best of -r runs)
+ *   -c <cmd>    "cmd file" exits with status 0 for the trace in file
+ *
+ * The first three replay the trace with mm.c in a child process, so that
+ * a crash or a hang in mm.c cannot take tracemin down with it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+extern char *optarg;
+
+#include "mm.h"
+#include "memlib.h"
+#include "trace.h"
+#include "ftimer.h"
+#include "config.h"
+
+#define MAXLINE 1024
+#define TIMEOUT 10 /* seconds a replay may take before it counts as a hang */
+
+/* Predicates */
+#define PRED_ERROR 0
+#define PRED_UTIL 1
+#define PRED_LATENCY 2
+#define PRED_CMD 3
+
+/* What a replay in the child measured, for the parent to judge */
+typedef struct
+{
+	double util;  /* peak payload / peak heap */
+	size_t heap;  /* peak heap */
+	double ns;	  /* best time per op */
+} result_t;
+
+int verbose = 0; /* read by read_trace */
+
+/* The predicate and its parameters */
+static int pred = -1;
+static double threshold;
+static int runs = 3;
+static char *cmd;
+static int fit_policy = MM_FIT_BEST;
+static int fit_max_probes = 0;
+static long heap_floor = -1; /* bytes; < 0 until set by -m or the first test */
+static result_t *result;	 /* shared with the replay child */
+
+static trace_t *orig; /* the trace being minimized */
+static char *keep;	  /* keep[i] is set while op i is in the trace */
+static int ntests;	  /* predicate evaluations so far */
+
+static trace_t *build_trace(void);
+static int replay_error(trace_t *trace);
+static double replay_util(trace_t *trace);
+static double replay_latency(trace_t *trace);
+static int test(void);
+static int ddmin(int nitems, int *start, int *ops);
+static int min_blocks(void);
+static int min_reallocs(void);
+static void usage(void);
+static void unix_error(char *msg);
+static void app_error(char *msg);
+
+/*
+ * build_trace - The trace of the ops still kept, with ids renumbered
+ * in order of first use
+ */
+static trace_t *build_trace(void)
+{
+	trace_t *trace;
+	int *newid;
+	int i, n = 0;
+
+	if ((trace = calloc(1, sizeof(trace_t))) == NULL ||
+		(trace->ops = malloc((orig->num_ops + 1) * sizeof(traceop_t))) == NULL ||
+		(newid = malloc(orig->num_ids * sizeof(int))) == NULL)
+		unix_error("malloc failed in build_trace");
+	for (i = 0; i < orig->num_ids; i++)
+		newid[i] = -1;
+	for (i = 0; i < orig->num_ops; i++)
+		if (keep[i])
+		{
+			traceop_t op = orig->ops[i];
+
+			if (newid[op.index] < 0)
+				newid[op.index] = trace->num_ids++;
+			op.index = newid[op.index];
+			trace->ops[n++] = op;
+		}
+	trace->num_ops = n;
+	trace->sugg_heapsize = orig->sugg_heapsize;
+	trace->weight = orig->weight;
+	if ((trace->blocks = calloc(trace->num_ids + 1, sizeof(char *))) == NULL ||
+		(trace->block_sizes = calloc(trace->num_ids + 1, sizeof(size_t))) == NULL)
+		unix_error("malloc failed in build_trace");
+	free(newid);
+	return trace;
+}
+
+/* The byte a block's payload holds at offset k */
+#define FILL(id, k) ((unsigned char)((id) * 131 + (k) * 7 + 1))
+
+/*
+ * check_block - Is the payload of block id still what we wrote, up to n?
+ */
+static int check_block(char *p, int id, size_t n)
+{
+	size_t k;
+
+	for (k = 0; k < n; k++)
+		if ((unsigned char)p[k] != FILL(id, k))
+			return 0;
+	return 1;
+}
+
+/*
+ * good_block - Is p a usable block of size bytes?
+ */
+static int good_block(char *p, int size)
+{
+	return p != NULL && ((size_t)p % ALIGNMENT) == 0 &&
+		   p >= (char *)mem_heap_lo() &&
+		   (size == 0 || p + size - 1 <= (char *)mem_heap_hi());
+}
+
+/*
+ * replay_error - Run the trace with mm.c, checking every block. Returns
+ * 1 if mm.c gets something wrong.
+ */
+static int replay_error(trace_t *trace)
+{
+	int i, id, size;
+	size_t k;
+	char *p = NULL;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		return 1;
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		id = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			if (!good_block(p = mm_malloc(size), size))
+				return 1;
+			break;
+		case REALLOC:
+			if (!check_block(trace->blocks[id], id, trace->block_sizes[id]))
+				return 1;
+			if (!good_block(p = mm_realloc(trace->blocks[id], size), size))
+				return 1;
+			if (!check_block(p, id, ((size_t)size < trace->block_sizes[id])
+										? (size_t)size
+										: trace->block_sizes[id]))
+				return 1;
+			break;
+		case FREE:
+			if (!check_block(trace->blocks[id], id, trace->block_sizes[id]))
+				return 1;
+			mm_free(trace->blocks[id]);
+			trace->blocks[id] = NULL;
+			trace->block_sizes[id] = 0;
+			continue;
+		}
+		for (k = 0; k < (size_t)size; k++)
+			p[k] = FILL(id, k);
+		trace->blocks[id] = p;
+		trace->block_sizes[id] = size;
+	}
+	return mm_check() != 0;
+}
+
+/*
+ * replay_util - Run the trace with mm.c and return its utilization
+ */
+static double replay_util(trace_t *trace)
+{
+	int i, id;
+	long live = 0, peak = 0;
+
+	mem_reset_brk();
+	if (mm_init() < 0)
+		app_error("mm_init failed");
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		id = trace->ops[i].index;
+		live -= trace->block_sizes[id];
+		switch (trace->ops[i].type)
+		{
+		case ALLOC:
+			trace->blocks[id] = mm_malloc(trace->ops[i].size);
+			break;
+		case REALLOC:
+			trace->blocks[id] = mm_realloc(trace->blocks[id], trace->ops[i].size);
+			break;
+		case FREE:
+			mm_free(trace->blocks[id]);
+			trace->block_sizes[id] = 0;
+			continue;
+		}
+		if (trace->blocks[id] == NULL)
+			app_error("mm.c ran out of heap");
+		trace->block_sizes[id] = trace->ops[i].size;
+		live += trace->ops[i].size;
+		if (live > peak)
+			peak = live;
+	}
+	return (mem_heappeak() > 0) ? (double)peak / mem_heappeak() : 1.0;
+}
+
+/*
+ * replay_latency - Run the trace with mm.c and return the best time per
+ * op, in ns, over the runs
+ */
+static double replay_latency(trace_t *trace)
+{
+	int i, r, id;
+	double start, secs, best = -1;
+
+	for (r = 0; r < runs; r++)
+	{
+		mem_reset_brk();
+		if (mm_init() < 0)
+			app_error("mm_init failed");
+		start = ftimer_now();
+		for (i = 0; i < trace->num_ops; i++)
+		{
+			id = trace->ops[i].index;
+			switch (trace->ops[i].type)
+			{
+			case ALLOC:
+				trace->blocks[id] = mm_malloc(trace->ops[i].size);
+				break;
+			case REALLOC:
+				trace->blocks[id] = mm_realloc(trace->blocks[id], trace->ops[i].size);
+				break;
+			case FREE:
+				mm_free(trace->blocks[id]);
+				break;
+			}
+		}
+		secs = ftimer_now() - start;
+		if (best < 0 || secs < best)
+			best = secs;
+	}
+	return (trace->num_ops > 0) ? best * 1e9 / trace->num_ops : 0;
+}
+
+/*
+ * test - Does the predicate hold for the ops still kept?
+ */
+static int test(void)
+{
+	trace_t *trace = build_trace();
+	char path[] = "/tmp/tracemin-XXXXXX";
+	char line[MAXLINE];
+	int status, fd;
+	FILE *fp;
+	pid_t pid;
+
+	ntests++;
+	if (pred == PRED_CMD)
+	{
+		if ((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+			unix_error("mkstemp failed in test");
+		write_trace(fp, trace);
+		fclose(fp);
+		snprintf(line, MAXLINE, "%s %s", cmd, path);
+		status = system(line);
+		unlink(path);
+		free_trace(trace);
+		return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	/*
+	 * The child exits 0 if mm.c got the trace right (for -e), or leaves
+	 * its measurements in result (for -u and -l)
+	 */
+	fflush(stdout);
+	if ((pid = fork()) < 0)
+		unix_error("fork failed in test");
+	if (pid == 0)
+	{
+		alarm(TIMEOUT);
+		if (pred == PRED_ERROR)
+			_exit(replay_error(trace));
+		if (pred == PRED_UTIL)
+		{
+			result->util = replay_util(trace);
+			result->heap = mem_heappeak();
+		}
+		else
+			result->ns = replay_latency(trace);
+		_exit(0);
+	}
+	free_trace(trace);
+	if (waitpid(pid, &status, 0) < 0)
+		unix_error("waitpid failed in test");
+	if (WIFSIGNALED(status)) /* a crash or a hang */
+		return pred == PRED_ERROR;
+	if (pred == PRED_ERROR || WEXITSTATUS(status) != 0)
+		return pred == PRED_ERROR && WEXITSTATUS(status) != 0;
+	if (pred == PRED_LATENCY)
+		return result->ns > threshold;
+	if (heap_floor < 0)
+		heap_floor = result->heap / 2;
+	return result->util * 100 < threshold && result->heap >= (size_t)heap_floor;
+}
+
+/*
+ * ddmin - Remove as many of the nitems items as the predicate allows.
+ * Item i is the ops ops[start[i]] .. ops[start[i+1]-1], all kept on
+ * entry. Returns the number of items removed.
+ */
+static int ddmin(int nitems, int *start, int *ops)
+{
+	int *alive, *chunk;
+	int nalive = nitems, n = 2;
+	int i, j, c, k, len, removed = 0;
+
+	if ((alive = malloc((nitems + 1) * sizeof(int))) == NULL ||
+		(chunk = malloc((nitems + 1) * sizeof(int))) == NULL)
+		unix_error("malloc failed in ddmin");
+	for (i = 0; i < nitems; i++)
+		alive[i] = i;
+
+	while (nalive > 0)
+	{
+		int shrunk = 0;
+
+		if (n > nalive)
+			n = nalive;
+
+		/* Try to remove each of n chunks of the items left */
+		for (c = 0; c < n && !shrunk; c++)
+		{
+			int lo = (long)nalive * c / n, hi = (long)nalive * (c + 1) / n;
+
+			for (j = lo; j < hi; j++)
+				for (k = start[alive[j]]; k < start[alive[j] + 1]; k++)
+					keep[ops[k]] = 0;
+			if (test())
+			{
+				len = 0;
+				for (j = 0; j < nalive; j++)
+					if (j < lo || j >= hi)
+						chunk[len++] = alive[j];
+				memcpy(alive, chunk, len * sizeof(int));
+				removed += nalive - len;
+				nalive = len;
+				n = (n > 2) ? n - 1 : 2;
+				shrunk = 1;
+				if (verbose)
+					fprintf(stderr, "tracemin: %d items left after %d tests\n",
+							nalive, ntests);
+			}
+			else
+				for (j = lo; j < hi; j++)
+					for (k = start[alive[j]]; k < start[alive[j] + 1]; k++)
+						keep[ops[k]] = 1;
+		}
+		if (!shrunk)
+		{
+			if (n >= nalive)
+				break;
+			n = (2 * n < nalive) ? 2 * n : nalive;
+		}
+	}
+	free(chunk);
+	free(alive);
+	return removed;
+}
+
+/*
+ * min_blocks - First pass: items are blocks, each with all its ops
+ */
+static int min_blocks(void)
+{
+	int *start, *ops, *fill;
+	int i, removed;
+
+	if ((start = calloc(orig->num_ids + 1, sizeof(int))) == NULL ||
+		(fill = malloc((orig->num_ids + 1) * sizeof(int))) == NULL ||
+		(ops = malloc((orig->num_ops + 1) * sizeof(int))) == NULL)
+		unix_error("malloc failed in min_blocks");
+	for (i = 0; i < orig->num_ops; i++)
+		start[orig->ops[i].index + 1]++;
+	for (i = 0; i < orig->num_ids; i++)
+		start[i + 1] += start[i];
+	memcpy(fill, start, orig->num_ids * sizeof(int));
+	for (i = 0; i < orig->num_ops; i++)
+		ops[fill[orig->ops[i].index]++] = i;
+
+	removed = ddmin(orig->num_ids, start, ops);
+	free(ops);
+	free(fill);
+	free(start);
+	return removed;
+}
+
+/*
+ * min_reallocs - Second pass: items are the reallocs still kept
+ */
+static int min_reallocs(void)
+{
+	int *start, *ops;
+	int i, n = 0, removed;
+
+	if ((start = malloc((orig->num_ops + 1) * sizeof(int))) == NULL ||
+		(ops = malloc((orig->num_ops + 1) * sizeof(int))) == NULL)
+		unix_error("malloc failed in min_reallocs");
+	for (i = 0; i < orig->num_ops; i++)
+		if (keep[i] && orig->ops[i].type == REALLOC)
+		{
+			start[n] = n;
+			ops[n++] = i;
+		}
+	start[n] = n;
+
+	removed = ddmin(n, start, ops);
+	free(ops);
+	free(start);
+	return removed;
+}
+
+int main(int argc, char **argv)
+{
+	char *infile = NULL, *outfile = "min.rep";
+	trace_t *trace;
+	FILE *fp;
+	int c, blocks, reallocs;
+
+	while ((c = getopt(argc, argv, "f:o:eu:m:l:r:c:F:K:vh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'f': /* The trace to minimize */
+			infile = optarg;
+			break;
+		case 'o': /* Where to write the result */
+			outfile = optarg;
+			break;
+		case 'e':
+			pred = PRED_ERROR;
+			break;
+		case 'u':
+			pred = PRED_UTIL;
+			threshold = atof(optarg);
+			break;
+		case 'm':
+			heap_floor = atol(optarg) * 1024;
+			break;
+		case 'l':
+			pred = PRED_LATENCY;
+			threshold = atof(optarg);
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 'c':
+			pred = PRED_CMD;
+			cmd = optarg;
+			break;
+		case 'F': /* Placement policy for mm.c */
+			if (!strcmp(optarg, "best"))
+				fit_policy = MM_FIT_BEST;
+			else if (!strcmp(optarg, "first"))
+				fit_policy = MM_FIT_FIRST;
+			else if (!strcmp(optarg, "next"))
+				fit_policy = MM_FIT_NEXT;
+			else
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'K': /* Give up on a bin after this many probes */
+			fit_max_probes = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (infile == NULL || pred < 0 || runs < 1)
+	{
+		usage();
+		exit(1);
+	}
+
+	orig = read_trace("", infile);
+	if ((keep = malloc(orig->num_ops + 1)) == NULL)
+		unix_error("malloc failed in main");
+	memset(keep, 1, orig->num_ops);
+	if (pred != PRED_CMD)
+	{
+		mem_init();
+		/* Every mm_init from here on, in this process or a child, uses it */
+		mm_set_fit_policy(fit_policy, fit_max_probes);
+		result = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE,
+					  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (result == MAP_FAILED)
+			unix_error("mmap failed in main");
+	}
+
+	if (!test())
+		app_error("the predicate does not hold for the whole trace");
+	blocks = min_blocks();
+	reallocs = min_reallocs();
+
+	trace = build_trace();
+	if ((fp = fopen(outfile, "w")) == NULL)
+		unix_error("could not open the output file");
+	write_trace(fp, trace);
+	fclose(fp);
+	printf("%s: %d ops, %d blocks (removed %d blocks, %d reallocs in %d tests)\n",
+		   outfile, trace->num_ops, trace->num_ids, blocks, reallocs, ntests);
+
+	free_trace(trace);
+	free(keep);
+	free_trace(orig);
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracemin -f <file> (-e | -u <pct> | -l <ns> | -c <cmd>) [-hv]\n");
+	fprintf(stderr, "                [-m <KB>] [-o <file>] [-r <runs>] [-F <policy>] [-K <probes>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-c <cmd>     Keep what makes \"<cmd> <trace>\" exit with 0.\n");
+	fprintf(stderr, "\t-e           Keep what makes mm.c fail.\n");
+	fprintf(stderr, "\t-f <file>    Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-F <policy>  Run mm.c with placement policy best, first or next.\n");
+	fprintf(stderr, "\t-h           Print this message.\n");
+	fprintf(stderr, "\t-K <probes>  Give up on an mm.c bin after <probes> probes.\n");
+	fprintf(stderr, "\t-l <ns>      Keep what makes mm.c take more than <ns> per op.\n");
+	fprintf(stderr, "\t-m <KB>      With -u, keep the heap at <KB> or more.\n");
+	fprintf(stderr, "\t-o <file>    Write the result to <file> (default min.rep).\n");
+	fprintf(stderr, "\t-r <runs>    Time -l over the best of <runs> runs (default 3).\n");
+	fprintf(stderr, "\t-u <pct>     Keep what makes utilization drop below <pct>%%.\n");
+	fprintf(stderr, "\t-v           Report progress.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * app_error - Report an arbitrary application error
+ */
+static void app_error(char *msg)
+{
+	printf("tracemin: %s\n", msg);
+	exit(1);
+}
@@ -0,0 +1,296 @@
+/*
+ * tracemix.c - Build larger traces out of existing ones
+ *
+ * Reads one or more trace files and writes a single new trace to stdout:
+ *
+ *   -s <factor>  multiplies every request size by factor (rounded up,
+ *                so that no request shrinks to nothing)
+ *   -n <copies>  uses every input copies times
+ *   -i <quantum> interleaves the inputs as concurrent tenants, taking
+ *                quantum ops from each in turn; without -i they are
+ *                concatenated, one after the other
+ *   -d <ops>     with -i, holds back the k-th tenant until k*ops ops
+ *                have been written, so that replicas are out of step
+ *
+ * Every input keeps its own block ids, shifted past those of the inputs
+ * before it. Like checktrace.pl, tracemix checks each input for
+ * consistency and balances the output by appending a free for every
+ * block still allocated at the end. It refuses to write a trace whose
+ * requests or live payload at peak do not fit in MAX_HEAP.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+extern char *optarg;
+extern int optind;
+
+#include "trace.h"
+#include "config.h"
+
+/* One input in the output: a trace, its id shift and how far it got */
+typedef struct
+{
+	trace_t *trace;
+	char *name;
+	int base;  /* first output id of this tenant */
+	int next;  /* next op to write */
+	long hold; /* ops to write before this tenant starts */
+} tenant_t;
+
+/* Block states, checked as checktrace.pl does */
+#define UNUSED 0
+#define LIVE 1
+#define FREED 2
+
+int verbose = 0; /* read by read_trace */
+
+static void emit(tenant_t *t, traceop_t *out, long *nout, char *state);
+static void usage(void);
+static void unix_error(char *msg);
+
+/*
+ * emit - Append tenant t's next op to out, remapped and checked
+ */
+static void emit(tenant_t *t, traceop_t *out, long *nout, char *state)
+{
+	traceop_t op = t->trace->ops[t->next++];
+	int id = t->base + op.index;
+
+	switch (op.type)
+	{
+	case ALLOC:
+		if (state[id] != UNUSED)
+		{
+			fprintf(stderr, "%s: op %d: %s of id %d\n", t->name, t->next - 1,
+					state[id] == LIVE ? "allocate with no intervening free"
+									  : "reused",
+					op.index);
+			exit(1);
+		}
+		state[id] = LIVE;
+		break;
+	case REALLOC:
+		if (state[id] != LIVE)
+		{
+			fprintf(stderr, "%s: op %d: realloc without previous alloc\n",
+					t->name, t->next - 1);
+			exit(1);
+		}
+		break;
+	case FREE:
+		if (state[id] != LIVE)
+		{
+			fprintf(stderr, "%s: op %d: freeing %s block\n", t->name,
+					t->next - 1, state[id] ? "already freed" : "unallocated");
+			exit(1);
+		}
+		state[id] = FREED;
+		break;
+	}
+	op.index = id;
+	out[(*nout)++] = op;
+}
+
+int main(int argc, char **argv)
+{
+	tenant_t *tenants;
+	trace_t mixed;
+	traceop_t *out;
+	char *state;
+	double scale = 1.0;
+	int copies = 1, quantum = 0;
+	long hold = 0, nout = 0, maxops = 0;
+	long live = 0, peak = 0, *size;
+	long heapsize = 0;
+	int ntenants, nids = 0, weight = 1;
+	int i, j, k, c;
+
+	while ((c = getopt(argc, argv, "s:n:i:d:h")) != EOF)
+	{
+		switch (c)
+		{
+		case 's':
+			scale = atof(optarg);
+			break;
+		case 'n':
+			copies = atoi(optarg);
+			break;
+		case 'i':
+			quantum = atoi(optarg);
+			break;
+		case 'd':
+			hold = atol(optarg);
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind == argc || scale <= 0 || copies < 1 || quantum < 0 || hold < 0)
+	{
+		usage();
+		exit(1);
+	}
+
+	/* Read the inputs; replicas share their trace but not their ids */
+	ntenants = (argc - optind) * copies;
+	if ((tenants = calloc(ntenants, sizeof(tenant_t))) == NULL)
+		unix_error("malloc failed in main");
+	for (i = 0; i < argc - optind; i++)
+	{
+		trace_t *trace = read_trace("", argv[optind + i]);
+
+		if (i == 0)
+			weight = trace->weight;
+		for (k = 0; k < trace->num_ops; k++)
+			if (trace->ops[k].type != FREE && trace->ops[k].size > 0)
+			{
+				/* In double, as the product may not fit in an int */
+				double scaled = trace->ops[k].size * scale + 0.999999;
+
+				if (scaled > MAX_HEAP) /* MAX_HEAP <= INT_MAX */
+				{
+					fprintf(stderr, "tracemix: %s: a %d-byte request scaled "
+									"by %g does not fit in MAX_HEAP (%d)\n",
+							argv[optind + i], trace->ops[k].size, scale, MAX_HEAP);
+					exit(1);
+				}
+				trace->ops[k].size = (int)scaled;
+			}
+		for (j = 0; j < copies; j++)
+		{
+			tenant_t *t = &tenants[i * copies + j];
+
+			t->trace = trace;
+			t->name = argv[optind + i];
+			t->base = nids;
+			nids += trace->num_ids;
+			maxops += trace->num_ops;
+			heapsize += trace->sugg_heapsize;
+		}
+	}
+	for (i = 0; i < ntenants; i++)
+		tenants[i].hold = quantum ? i * hold : 0;
+
+	/* Every id may need one balancing free on top of the ops */
+	if ((out = malloc((maxops + nids) * sizeof(traceop_t))) == NULL ||
+		(state = calloc(nids, 1)) == NULL ||
+		(size = calloc(nids, sizeof(long))) == NULL)
+		unix_error("malloc failed in main");
+
+	if (quantum == 0)
+	{
+		for (i = 0; i < ntenants; i++)
+			while (tenants[i].next < tenants[i].trace->num_ops)
+				emit(&tenants[i], out, &nout, state);
+	}
+	else
+	{
+		/*
+		 * Round robin over the tenants that have started. If none has
+		 * (the ones that were running are done), start the next held one.
+		 */
+		int left = 0;
+
+		for (i = 0; i < ntenants; i++)
+			left += (tenants[i].trace->num_ops > 0);
+		while (left > 0)
+		{
+			int ran = 0;
+
+			for (i = 0; i < ntenants; i++)
+			{
+				tenant_t *t = &tenants[i];
+
+				if (t->next == t->trace->num_ops || t->hold > nout)
+					continue;
+				for (k = 0; k < quantum && t->next < t->trace->num_ops; k++)
+					emit(t, out, &nout, state);
+				if (t->next == t->trace->num_ops)
+					left--;
+				ran = 1;
+			}
+			if (!ran)
+				for (i = 0; i < ntenants; i++)
+					if (tenants[i].next < tenants[i].trace->num_ops)
+					{
+						tenants[i].hold = 0;
+						break;
+					}
+		}
+	}
+
+	/* Balance the trace, as checktrace.pl does */
+	for (i = 0; i < nids; i++)
+		if (state[i] == LIVE)
+		{
+			out[nout].type = FREE;
+			out[nout].index = i;
+			out[nout++].size = 0;
+		}
+
+	/* No allocator can run a trace whose live payload outgrows memlib */
+	for (k = 0; k < nout; k++)
+	{
+		live -= size[out[k].index];
+		size[out[k].index] = (out[k].type == FREE) ? 0 : out[k].size;
+		live += size[out[k].index];
+		if (live > peak)
+			peak = live;
+	}
+	if (peak > MAX_HEAP)
+	{
+		fprintf(stderr, "tracemix: %ld bytes live at peak, "
+						"more than MAX_HEAP (%d)\n",
+				peak, MAX_HEAP);
+		exit(1);
+	}
+
+	/* The suggestion is never used, and one trace may already ask for
+	   more than MAX_HEAP, so cap the sum rather than reject the mix */
+	mixed.sugg_heapsize = (heapsize > MAX_HEAP) ? MAX_HEAP : (int)heapsize;
+	mixed.num_ids = nids;
+	mixed.num_ops = nout;
+	mixed.weight = weight;
+	mixed.ops = out;
+	write_trace(stdout, &mixed);
+
+	for (i = 0; i < argc - optind; i++)
+		free_trace(tenants[i * copies].trace);
+	free(size);
+	free(state);
+	free(out);
+	free(tenants);
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracemix [-h] [-s <factor>] [-n <copies>] "
+					"[-i <quantum> [-d <ops>]] <file> ...\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-h            Print this message.\n");
+	fprintf(stderr, "\t-s <factor>   Multiply request sizes by <factor>.\n");
+	fprintf(stderr, "\t-n <copies>   Use each file <copies> times.\n");
+	fprintf(stderr, "\t-i <quantum>  Interleave the files, <quantum> ops at a time.\n");
+	fprintf(stderr, "\t-d <ops>      Start the k-th interleaved file after k*<ops> ops.\n");
+	fprintf(stderr, "The new trace is written to stdout, balanced.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
@@ -0,0 +1,450 @@
+/*
+ * tracestat.c - Summarize what a trace asks of an allocator
+ *
+ * For each trace: request sizes by power-of-two class, block lifetimes
+ * in ops, realloc chain lengths, peak live bytes and blocks, and the
+ * sizes requested most often. From the size distribution it derives
+ * free-list bin boundaries (one bin per equal share of the requests) and
+ * slab classes (the block sizes that cover most requests by themselves),
+ * both in mm.c block sizes, so that these settings can follow the data.
+ *
+ * Output is text by default, or one JSON array with -j.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+extern char *optarg;
+
+#include "trace.h"
+#include "config.h"
+
+#define MAXLINE 1024
+#define NCLASS 34		 /* classes 0, 1, then (2^(k-2), 2^(k-1)] */
+#define NTOP 10			 /* most frequent sizes to list */
+#define NBINS 10		 /* bins to derive (mm.c's N_LISTS) */
+#define SLAB_COVER 0.80	 /* slab classes cover this share of requests */
+#define SLAB_MIN 0.02	 /* ... each taking at least this share */
+
+/* mm.c block size for a request (payload plus tags, 16-byte aligned) */
+#define BLOCK_SIZE(size) ((size) <= 16 ? 32 : ((size) + 16 + 15) / 16 * 16)
+
+/* One distinct request size and how often it was asked for */
+typedef struct
+{
+	int size;
+	int count;
+} sizecount_t;
+
+/* Summary of one trace */
+typedef struct
+{
+	char *name;
+	int ops, allocs, reallocs, frees;
+	long size_hist[NCLASS];	 /* requests per size class */
+	long bytes_hist[NCLASS]; /* requested bytes per size class */
+	long life_hist[NCLASS];	 /* freed blocks per lifetime class (ops) */
+	long never_freed;		 /* blocks live at the end of the trace */
+	long chain_hist[NCLASS]; /* blocks per class of realloc count (0 = none) */
+	long max_chain;
+	long peak_bytes;  /* most payload bytes live at once */
+	long peak_blocks; /* most blocks live at once */
+	sizecount_t *sizes; /* distinct sizes, most requested first */
+	int nsizes;
+	int bins[NBINS - 1]; /* derived bin limits (block sizes) */
+	int nbins;			 /* limits in bins (duplicates dropped) */
+	int slabs[NTOP];	 /* derived slab classes (block sizes) */
+	int nslabs;
+	double slab_cover; /* share of requests the slab classes serve */
+} tstat_t;
+
+int verbose = 0; /* read by read_trace */
+
+/* Directory where default tracefiles are found */
+static char tracedir[MAXLINE] = TRACEDIR;
+
+/* The filenames of the default tracefiles */
+static char *default_tracefiles[] = {
+	DEFAULT_TRACEFILES, NULL};
+
+static int size_class(long n);
+static long class_lo(int k);
+static long class_hi(int k);
+static void analyze(trace_t *trace, tstat_t *st);
+static void derive_settings(tstat_t *st, int *reqs, int nreqs);
+static int cmp_int(const void *a, const void *b);
+static int cmp_count(const void *a, const void *b);
+static void print_hist(char *title, char *unit, long *hist);
+static void print_text(tstat_t *st);
+static void print_json_hist(char *key, long *hist, int last);
+static void print_json(tstat_t *st, int first);
+static void usage(void);
+static void unix_error(char *msg);
+
+/*
+ * size_class - Power-of-two class of n: 0 and 1 have classes of their
+ * own, class k > 1 holds (2^(k-2), 2^(k-1)]
+ */
+static int size_class(long n)
+{
+	int k = 1;
+
+	if (n <= 0)
+		return 0;
+	while (k < NCLASS - 1 && (1L << (k - 1)) < n)
+		k++;
+	return k;
+}
+
+/* class_lo, class_hi - Smallest and largest value in class k */
+static long class_lo(int k)
+{
+	return (k <= 1) ? k : (1L << (k - 2)) + 1;
+}
+
+static long class_hi(int k)
+{
+	return (k == 0) ? 0 : 1L << (k - 1);
+}
+
+/*
+ * analyze - Replay the trace's bookkeeping (no allocator) into st
+ */
+static void analyze(trace_t *trace, tstat_t *st)
+{
+	int *born, *chain, *size, *reqs;
+	int i, index, nreqs = 0;
+	long live_bytes = 0, live_blocks = 0;
+
+	born = calloc(trace->num_ids, sizeof(int));
+	chain = calloc(trace->num_ids, sizeof(int));
+	size = calloc(trace->num_ids, sizeof(int));
+	reqs = malloc((trace->num_ops + 1) * sizeof(int));
+	if (born == NULL || chain == NULL || size == NULL || reqs == NULL)
+		unix_error("malloc failed in analyze");
+	for (i = 0; i < trace->num_ids; i++)
+		born[i] = -1;
+
+	st->ops = trace->num_ops;
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		traceop_t *op = &trace->ops[i];
+
+		index = op->index;
+		switch (op->type)
+		{
+		case ALLOC:
+			st->allocs++;
+			born[index] = i;
+			chain[index] = 0;
+			size[index] = op->size;
+			live_bytes += op->size;
+			live_blocks++;
+			break;
+		case REALLOC:
+			st->reallocs++;
+			if (born[index] < 0) /* realloc of nothing is a malloc */
+			{
+				born[index] = i;
+				chain[index] = 0;
+				live_blocks++;
+			}
+			else
+				chain[index]++;
+			live_bytes += op->size - size[index];
+			size[index] = op->size;
+			break;
+		case FREE:
+			st->frees++;
+			if (born[index] < 0)
+				break;
+			st->life_hist[size_class(i - born[index])]++;
+			st->chain_hist[size_class(chain[index])]++;
+			if (chain[index] > st->max_chain)
+				st->max_chain = chain[index];
+			live_bytes -= size[index];
+			live_blocks--;
+			born[index] = -1;
+			break;
+		}
+		if (op->type != FREE)
+		{
+			st->size_hist[size_class(op->size)]++;
+			st->bytes_hist[size_class(op->size)] += op->size;
+			reqs[nreqs++] = op->size;
+		}
+		if (live_bytes > st->peak_bytes)
+			st->peak_bytes = live_bytes;
+		if (live_blocks > st->peak_blocks)
+			st->peak_blocks = live_blocks;
+	}
+
+	/* Blocks never freed still count for their realloc chains */
+	for (i = 0; i < trace->num_ids; i++)
+		if (born[i] >= 0)
+		{
+			st->never_freed++;
+			st->chain_hist[size_class(chain[i])]++;
+			if (chain[i] > st->max_chain)
+				st->max_chain = chain[i];
+		}
+
+	derive_settings(st, reqs, nreqs);
+	free(reqs);
+	free(size);
+	free(chain);
+	free(born);
+}
+
+/*
+ * derive_settings - Count each distinct size, then derive bin limits and
+ * slab classes from the requests in reqs (which it sorts)
+ */
+static void derive_settings(tstat_t *st, int *reqs, int nreqs)
+{
+	int i, j, b, *blocks;
+	long covered = 0;
+
+	qsort(reqs, nreqs, sizeof(int), cmp_int);
+	if ((st->sizes = malloc((nreqs + 1) * sizeof(sizecount_t))) == NULL ||
+		(blocks = malloc((nreqs + 1) * sizeof(int))) == NULL)
+		unix_error("malloc failed in derive_settings");
+	for (i = 0; i < nreqs; i = j)
+	{
+		for (j = i; j < nreqs && reqs[j] == reqs[i]; j++)
+			;
+		st->sizes[st->nsizes].size = reqs[i];
+		st->sizes[st->nsizes++].count = j - i;
+	}
+	qsort(st->sizes, st->nsizes, sizeof(sizecount_t), cmp_count);
+
+	/*
+	 * Bin limits: block sizes at every NBINS-quantile of the requests.
+	 * Sizes that fill several quantiles alone give one limit, not several.
+	 */
+	for (i = 0; i < nreqs; i++)
+		blocks[i] = BLOCK_SIZE(reqs[i]);
+	for (b = 0; b < NBINS - 1 && nreqs > 0; b++)
+	{
+		int limit = blocks[(long)nreqs * (b + 1) / NBINS];
+
+		if (st->nbins == 0 || limit > st->bins[st->nbins - 1])
+			st->bins[st->nbins++] = limit;
+	}
+
+	/*
+	 * Slab classes: the most requested block sizes, while each serves a
+	 * fair share of requests and until they cover SLAB_COVER of them
+	 */
+	for (i = 0; i < nreqs; i = j)
+	{
+		for (j = i; j < nreqs && blocks[j] == blocks[i]; j++)
+			;
+		reqs[i] = j - i; /* reuse reqs to hold the count of the run */
+	}
+	while (st->nslabs < NTOP && covered < SLAB_COVER * nreqs)
+	{
+		int best = -1;
+
+		for (i = 0; i < nreqs; i++)
+			if ((i == 0 || blocks[i] != blocks[i - 1]) && reqs[i] > 0 &&
+				(best < 0 || reqs[i] > reqs[best]))
+				best = i;
+		if (best < 0 || reqs[best] < SLAB_MIN * nreqs)
+			break;
+		st->slabs[st->nslabs++] = blocks[best];
+		covered += reqs[best];
+		reqs[best] = 0;
+	}
+	st->slab_cover = nreqs ? (double)covered / nreqs : 0;
+	qsort(st->slabs, st->nslabs, sizeof(int), cmp_int);
+	free(blocks);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static int cmp_count(const void *a, const void *b)
+{
+	const sizecount_t *x = a, *y = b;
+
+	return (x->count != y->count) ? y->count - x->count : x->size - y->size;
+}
+
+/*
+ * print_hist - Print the non-empty classes of a histogram
+ */
+static void print_hist(char *title, char *unit, long *hist)
+{
+	int k;
+	long total = 0;
+
+	for (k = 0; k < NCLASS; k++)
+		total += hist[k];
+	printf("  %s\n", title);
+	for (k = 0; k < NCLASS; k++)
+		if (hist[k])
+			printf("    %10ld .. %-10ld %-5s %8ld  %5.1f%%\n",
+				   class_lo(k), class_hi(k), unit, hist[k],
+				   100.0 * hist[k] / total);
+}
+
+/*
+ * print_text - Human-readable report for one trace
+ */
+static void print_text(tstat_t *st)
+{
+	int i;
+
+	printf("%s: %d ops (%d alloc, %d realloc, %d free)\n",
+		   st->name, st->ops, st->allocs, st->reallocs, st->frees);
+	printf("  peak live: %ld bytes in %ld blocks; %ld blocks never freed\n",
+		   st->peak_bytes, st->peak_blocks, st->never_freed);
+	print_hist("request sizes:", "bytes", st->size_hist);
+	print_hist("lifetimes of freed blocks:", "ops", st->life_hist);
+	print_hist("reallocs per block:", "", st->chain_hist);
+	printf("  longest realloc chain: %ld\n", st->max_chain);
+	printf("  %d distinct sizes; most requested:\n", st->nsizes);
+	for (i = 0; i < st->nsizes && i < NTOP; i++)
+		printf("    %10d bytes %8d  %5.1f%%\n", st->sizes[i].size,
+			   st->sizes[i].count,
+			   100.0 * st->sizes[i].count / (st->allocs + st->reallocs));
+	printf("  derived bin limits (block bytes):");
+	for (i = 0; i < st->nbins; i++)
+		printf(" %d", st->bins[i]);
+	printf("\n  derived slab classes (block bytes):");
+	for (i = 0; i < st->nslabs; i++)
+		printf(" %d", st->slabs[i]);
+	printf(" (%.1f%% of requests)\n\n", 100.0 * st->slab_cover);
+}
+
+/*
+ * print_json_hist - One histogram as a JSON array of [lo, hi, count]
+ */
+static void print_json_hist(char *key, long *hist, int last)
+{
+	int k, first = 1;
+
+	printf("    \"%s\": [", key);
+	for (k = 0; k < NCLASS; k++)
+		if (hist[k])
+		{
+			printf("%s[%ld, %ld, %ld]", first ? "" : ", ",
+				   class_lo(k), class_hi(k), hist[k]);
+			first = 0;
+		}
+	printf("]%s\n", last ? "" : ",");
+}
+
+/*
+ * print_json - One trace as a JSON object
+ */
+static void print_json(tstat_t *st, int first)
+{
+	int i;
+
+	printf("%s  {\n", first ? "" : ",\n");
+	printf("    \"trace\": \"%s\",\n", st->name);
+	printf("    \"ops\": %d, \"allocs\": %d, \"reallocs\": %d, \"frees\": %d,\n",
+		   st->ops, st->allocs, st->reallocs, st->frees);
+	printf("    \"peak_live_bytes\": %ld, \"peak_live_blocks\": %ld, \"never_freed\": %ld,\n",
+		   st->peak_bytes, st->peak_blocks, st->never_freed);
+	print_json_hist("size_hist", st->size_hist, 0);
+	print_json_hist("lifetime_hist", st->life_hist, 0);
+	print_json_hist("realloc_chain_hist", st->chain_hist, 0);
+	printf("    \"max_realloc_chain\": %ld,\n", st->max_chain);
+	printf("    \"distinct_sizes\": %d,\n", st->nsizes);
+	printf("    \"top_sizes\": [");
+	for (i = 0; i < st->nsizes && i < NTOP; i++)
+		printf("%s[%d, %d]", i ? ", " : "", st->sizes[i].size, st->sizes[i].count);
+	printf("],\n    \"bin_limits\": [");
+	for (i = 0; i < st->nbins; i++)
+		printf("%s%d", i ? ", " : "", st->bins[i]);
+	printf("],\n    \"slab_classes\": [");
+	for (i = 0; i < st->nslabs; i++)
+		printf("%s%d", i ? ", " : "", st->slabs[i]);
+	printf("],\n    \"slab_cover\": %.4f\n  }", st->slab_cover);
+}
+
+int main(int argc, char **argv)
+{
+	char **tracefiles = default_tracefiles;
+	char *onefile[2] = {NULL, NULL};
+	int json = 0;
+	int i, c;
+	trace_t *trace;
+	tstat_t st;
+
+	while ((c = getopt(argc, argv, "f:t:jh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'f': /* Use one specific trace file only (relative to curr dir) */
+			onefile[0] = optarg;
+			tracefiles = onefile;
+			strcpy(tracedir, "./");
+			break;
+		case 't': /* Directory where the traces are located */
+			if (onefile[0] != NULL)
+				break;
+			strcpy(tracedir, optarg);
+			if (tracedir[strlen(tracedir) - 1] != '/')
+				strcat(tracedir, "/");
+			break;
+		case 'j':
+			json = 1;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
+	if (json)
+		printf("[\n");
+	for (i = 0; tracefiles[i] != NULL; i++)
+	{
+		trace = read_trace(tracedir, tracefiles[i]);
+		memset(&st, 0, sizeof(st));
+		st.name = tracefiles[i];
+		analyze(trace, &st);
+		if (json)
+			print_json(&st, i == 0);
+		else
+			print_text(&st);
+		free(st.sizes);
+		free_trace(trace);
+	}
+	if (json)
+		printf("\n]\n");
+	return 0;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: tracestat [-hj] [-f <file>] [-t <dir>]\n");
+	fprintf(stderr, "Options\n");
+	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-j         Print JSON instead of text.\n");
+	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+	fprintf(stderr, "%s: %s\n", msg, strerror(errno));
+	exit(1);
+}